@@ -1,93 +1,94 @@
 #include "activations.hpp"
 
 // Tanh implementation
-std::vector<Eigen::MatrixXd> Tanh::forward(const std::vector<Eigen::MatrixXd>& input) {
-    this->input = input;
-    std::vector<Eigen::MatrixXd> output(input.size());
-    for (size_t i = 0; i < input.size(); ++i) {
-        output[i] = input[i].array().tanh();
+Tensor Tanh::forward(const Tensor& input) {
+    if (training) {
+        this->input = input;
     }
+    Tensor output = make_output(input.shape());
+    output.flat() = input.flat().array().tanh();
     return output;
 }
 
 
-std::vector<Eigen::MatrixXd> Tanh::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    std::vector<Eigen::MatrixXd> result(output_gradient.size());
-    for (size_t i = 0; i < output_gradient.size(); ++i) {
-        Eigen::ArrayXXd tanh_val = input[i].array().tanh();
-        result[i] = output_gradient[i].array() * (1 - tanh_val.square());
-    }
+Tensor Tanh::backward(const Tensor& output_gradient) {
+    Tensor result = make_input_gradient(output_gradient.shape());
+    result.flat() = output_gradient.flat().array() * (1 - input.flat().array().tanh().square());
     return result;
 }
 
 
 // Sigmoid implementation
-std::vector<Eigen::MatrixXd> Sigmoid::forward(const std::vector<Eigen::MatrixXd>& input) {
-    this->input = input;
-    std::vector<Eigen::MatrixXd> output(input.size());
-    for (size_t i = 0; i < input.size(); ++i) {
-        output[i] = (1.0 / (1.0 + (-input[i].array()).exp())).matrix();
+Tensor Sigmoid::forward(const Tensor& input) {
+    if (training) {
+        this->input = input;
     }
+    Tensor output = make_output(input.shape());
+    output.flat() = (Scalar(1) / (1 + (-input.flat().array()).exp())).matrix();
     return output;
 }
 
 
-std::vector<Eigen::MatrixXd> Sigmoid::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    std::vector<Eigen::MatrixXd> result(output_gradient.size());
-    for (size_t i = 0; i < output_gradient.size(); ++i) {
-        Eigen::ArrayXXd sigmoid = 1.0 / (1.0 + (-input[i].array()).exp());
-        result[i] = (output_gradient[i].array() * sigmoid * (1 - sigmoid)).matrix();
-    }
+Tensor Sigmoid::backward(const Tensor& output_gradient) {
+    Tensor result = make_input_gradient(output_gradient.shape());
+    // Sigmoid first, then the derivative in place, so no temporary is needed
+    result.flat() = (Scalar(1) / (1 + (-input.flat().array()).exp())).matrix();
+    result.flat() = (output_gradient.flat().array() * result.flat().array() * (1 - result.flat().array())).matrix();
     return result;
 }
 
 
 // ReLU implementation
-std::vector<Eigen::MatrixXd> ReLU::forward(const std::vector<Eigen::MatrixXd>& input) {
-    this->input = input;
-    std::vector<Eigen::MatrixXd> output(input.size());
-    for (size_t i = 0; i < input.size(); ++i) {
-        output[i] = input[i].cwiseMax(0.0);
+Tensor ReLU::forward(const Tensor& input) {
+    if (training) {
+        this->input = input;
     }
+    Tensor output = make_output(input.shape());
+    output.flat() = input.flat().cwiseMax(Scalar(0));
     return output;
 }
 
 
-std::vector<Eigen::MatrixXd> ReLU::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    std::vector<Eigen::MatrixXd> result(output_gradient.size());
-    for (size_t i = 0; i < output_gradient.size(); ++i) {
-        result[i] = (input[i].array() > 0).select(output_gradient[i].array(), 0.0);
-    }
+Tensor ReLU::backward(const Tensor& output_gradient) {
+    Tensor result = make_input_gradient(output_gradient.shape());
+    result.flat() = (input.flat().array() > 0).select(output_gradient.flat().array(), Scalar(0));
     return result;
 }
 
 // Softmax implementation
-std::vector<Eigen::MatrixXd> Softmax::forward(const std::vector<Eigen::MatrixXd>& input) {
-    this->input = input;
-    std::vector<Eigen::MatrixXd> output(input.size());
-
-    for (size_t i = 0; i < input.size(); ++i) {
-        Eigen::ArrayXXd exps = (input[i].array() - input[i].maxCoeff()).exp();
-        output[i] = (exps / exps.sum()).matrix();
+// Normalises each channel of each sample independently
+Tensor Softmax::forward(const Tensor& input) {
+    if (training) {
+        this->input = input;
+    }
+    Tensor output = make_output(input.shape());
+
+    for (int n = 0; n < input.batch(); ++n) {
+        for (int c = 0; c < input.channels(); ++c) {
+            auto in = input.channel(n, c);
+            auto out = output.channel(n, c);
+            out = (in.array() - in.maxCoeff()).exp().matrix();
+            out /= out.sum();
+        }
     }
     return output;
 }
 
-std::vector<Eigen::MatrixXd> Softmax::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    std::vector<Eigen::MatrixXd> result(output_gradient.size());
-    for (size_t i = 0; i < output_gradient.size(); ++i) {
-        Eigen::ArrayXXd exps = (input[i].array() - input[i].maxCoeff()).exp();
-        Eigen::ArrayXXd softmax = exps / exps.sum();
-
-        Eigen::ArrayXXd grad_input = Eigen::ArrayXXd::Zero(input[i].rows(), input[i].cols());
-
-        for (int j = 0; j < softmax.size(); ++j) {
-            double s = softmax(j);
-            double grad_sum = (output_gradient[i].array() * softmax).sum();
-            grad_input(j) = s * (output_gradient[i](j) - grad_sum);
+Tensor Softmax::backward(const Tensor& output_gradient) {
+    Tensor result = make_input_gradient(output_gradient.shape());
+    for (int n = 0; n < input.batch(); ++n) {
+        for (int c = 0; c < input.channels(); ++c) {
+            auto in = input.channel(n, c);
+            auto grad = output_gradient.channel(n, c);
+            // Recompute the softmax straight into the result
+            auto softmax = result.channel(n, c);
+            softmax = (in.array() - in.maxCoeff()).exp().matrix();
+            softmax /= softmax.sum();
+
+            // Same for every j, so compute it once
+            Scalar grad_sum = (grad.array() * softmax.array()).sum();
+            softmax = (softmax.array() * (grad.array() - grad_sum)).matrix();
         }
-
-        result[i] = grad_input.matrix();
     }
     return result;
 }
@@ -4,24 +4,32 @@
 
 class Tanh : public Layer {
 public:
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "Tanh"; }
+    std::shared_ptr<Layer> clone() const override { return std::make_shared<Tanh>(); }
 };
 
 class Sigmoid : public Layer {
 public:
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "Sigmoid"; }
+    std::shared_ptr<Layer> clone() const override { return std::make_shared<Sigmoid>(); }
 }; 
 
 class ReLU : public Layer {
 public:
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "ReLU"; }
+    std::shared_ptr<Layer> clone() const override { return std::make_shared<ReLU>(); }
 }; 
 
 class Softmax : public Layer {
 public:
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "Softmax"; }
+    std::shared_ptr<Layer> clone() const override { return std::make_shared<Softmax>(); }
 }; 
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "checkpoint.hpp"
+#include "mapped_file.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    const char file_magic[8] = {'N', 'N', 'C', 'K', 'P', 'T', '\0', '\0'};
+    // Reads back as something else when the file was written with the other byte order
+    constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t scalar_size;
+        std::uint32_t byte_order;
+        std::uint32_t layer_count;
+        std::uint64_t data_offset;
+    };
+
+    struct ParameterRecord {
+        std::int32_t shape[4];
+        std::uint64_t offset;
+    };
+
+    std::uint64_t align(std::uint64_t n) {
+        return (n + Tensor::alignment - 1) / Tensor::alignment * Tensor::alignment;
+    }
+
+    std::uint64_t blob_bytes(const Tensor::Shape& shape) {
+        return static_cast<std::uint64_t>(shape[0]) * shape[1] * shape[2] * shape[3] * sizeof(Scalar);
+    }
+
+    [[noreturn]] void fail(const std::string& path, const std::string& what) {
+        throw std::runtime_error("Checkpoint " + path + ": " + what);
+    }
+
+    std::string shape_string(const Tensor::Shape& shape) {
+        return "(" + std::to_string(shape[0]) + ", " + std::to_string(shape[1]) + ", " +
+               std::to_string(shape[2]) + ", " + std::to_string(shape[3]) + ")";
+    }
+}
+
+namespace Checkpoint {
+    void save(const std::vector<std::shared_ptr<Layer>>& layers, const std::string& path) {
+        // Size the header first so every blob offset is known before anything is written
+        std::uint64_t header_size = sizeof(Header);
+        for (const auto& layer : layers) {
+            header_size += sizeof(std::uint32_t) + layer->name().size() + sizeof(std::uint32_t) +
+                           layer->parameters().size() * sizeof(ParameterRecord);
+        }
+
+        Header header;
+        std::memcpy(header.magic, file_magic, sizeof(file_magic));
+        header.version = version;
+        header.scalar_size = sizeof(Scalar);
+        header.byte_order = byte_order_mark;
+        header.layer_count = static_cast<std::uint32_t>(layers.size());
+        header.data_offset = align(header_size);
+
+        // Written next to the target and renamed over it, so a reader never maps a half-written file
+        std::string temporary = path + ".tmp";
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            fail(path, "cannot open " + temporary + " for writing");
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        std::vector<std::pair<const Tensor*, std::uint64_t>> blobs;
+        std::uint64_t offset = header.data_offset;
+        for (const auto& layer : layers) {
+            std::string name = layer->name();
+            std::uint32_t name_length = static_cast<std::uint32_t>(name.size());
+            out.write(reinterpret_cast<const char*>(&name_length), sizeof(name_length));
+            out.write(name.data(), name_length);
+
+            std::vector<Tensor*> parameters = layer->parameters();
+            std::uint32_t count = static_cast<std::uint32_t>(parameters.size());
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            for (const Tensor* parameter : parameters) {
+                ParameterRecord record;
+                for (int d = 0; d < 4; ++d) {
+                    record.shape[d] = parameter->shape()[d];
+                }
+                record.offset = offset;
+                out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+                blobs.emplace_back(parameter, offset);
+                offset = align(offset + blob_bytes(parameter->shape()));
+            }
+        }
+
+        // Zero padding up to each blob's aligned offset
+        const char zeros[Tensor::alignment] = {};
+        std::uint64_t position = header_size;
+        for (const auto& [parameter, blob_offset] : blobs) {
+            out.write(zeros, blob_offset - position);
+            out.write(reinterpret_cast<const char*>(parameter->data()), blob_bytes(parameter->shape()));
+            position = blob_offset + blob_bytes(parameter->shape());
+        }
+
+        out.close();
+        if (!out) {
+            std::remove(temporary.c_str());
+            fail(path, "write failed");
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            fail(path, "cannot replace the previous file");
+        }
+    }
+
+    void load(const std::vector<std::shared_ptr<Layer>>& layers, const std::string& path) {
+        auto file = std::make_shared<MappedFile>(path);
+        MappedReader reader(*file);
+
+        Header header = reader.read<Header>();
+        if (std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0) {
+            fail(path, "not a checkpoint");
+        }
+        if (header.byte_order != byte_order_mark) {
+            fail(path, "written with a different byte order");
+        }
+        if (header.version != version) {
+            fail(path, "version " + std::to_string(header.version) + ", expected " + std::to_string(version));
+        }
+        if (header.scalar_size != sizeof(Scalar)) {
+            fail(path, "holds " + std::to_string(header.scalar_size * 8) + "-bit parameters, this build uses " +
+                       std::to_string(sizeof(Scalar) * 8) + "-bit");
+        }
+        if (header.layer_count != layers.size()) {
+            fail(path, std::to_string(header.layer_count) + " layers, the network has " + std::to_string(layers.size()));
+        }
+
+        // Check the whole file before touching any layer, so a bad one leaves the network as it was
+        std::vector<std::pair<Tensor*, std::uint64_t>> blobs;
+        for (std::size_t i = 0; i < layers.size(); ++i) {
+            std::string name = reader.read_string(reader.read<std::uint32_t>());
+            std::string where = "layer " + std::to_string(i) + " (" + layers[i]->name() + ")";
+            if (name != layers[i]->name()) {
+                fail(path, where + " was saved as " + name);
+            }
+            std::vector<Tensor*> parameters = layers[i]->parameters();
+            std::uint32_t count = reader.read<std::uint32_t>();
+            if (count != parameters.size()) {
+                fail(path, where + " has " + std::to_string(count) + " parameters, expected " +
+                           std::to_string(parameters.size()));
+            }
+            for (Tensor* parameter : parameters) {
+                ParameterRecord record = reader.read<ParameterRecord>();
+                Tensor::Shape shape = {record.shape[0], record.shape[1], record.shape[2], record.shape[3]};
+                if (shape != parameter->shape()) {
+                    fail(path, where + " parameter saved as " + shape_string(shape) + ", expected " +
+                               shape_string(parameter->shape()));
+                }
+                if (record.offset % Tensor::alignment != 0 || record.offset > file->size() ||
+                    blob_bytes(shape) > file->size() - record.offset) {
+                    fail(path, where + " parameter lies outside the file");
+                }
+                blobs.emplace_back(parameter, record.offset);
+            }
+        }
+
+        for (const auto& [parameter, offset] : blobs) {
+            *parameter = Tensor::external(reinterpret_cast<Scalar*>(file->data() + offset), parameter->shape(), file);
+        }
+        for (const auto& layer : layers) {
+            layer->parameters_changed();
+        }
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "layer.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Binary checkpoints of layer parameters, loaded by memory-mapping
+ *
+ * File layout (native byte order, every field fixed width):
+ *
+ *   header      magic "NNCKPT\0\0", version, sizeof(Scalar), byte-order mark,
+ *               layer count, offset of the first blob
+ *   per layer   type name (length-prefixed), parameter count, and for every
+ *               parameter its 4-D shape and the file offset of its blob
+ *   blobs       raw Scalars of every parameter, each starting on a
+ *               Tensor::alignment boundary
+ *
+ * load() checks the header against the layers it is given (same types, same
+ * parameter shapes, same Scalar) and then points every parameter straight at its
+ * blob in the mapping, so nothing is parsed or copied however large the model is.
+ * The mapping is private: processes loading the same file share its pages, and a
+ * process that keeps training gets its own copy of just the pages it updates.
+ */
+namespace Checkpoint {
+    constexpr std::uint32_t version = 1;
+
+    // Throws std::runtime_error if the file cannot be written
+    void save(const std::vector<std::shared_ptr<Layer>>& layers, const std::string& path);
+    // Throws std::runtime_error if the file is unreadable, truncated, from another version
+    // or Scalar type, or does not match the layers
+    void load(const std::vector<std::shared_ptr<Layer>>& layers, const std::string& path);
+}
@@ -0,0 +1,124 @@
+// Save/load round trips of Network checkpoints: predictions after load match the saved
+// network, fused and unfused networks load each other's files, and training a loaded
+// network never writes back into the file.
+// Build and run with `make test_checkpoint`; exits non-zero if any check fails
+#include "network.hpp"
+#include "convolutional.hpp"
+#include "activations.hpp"
+#include "pooling.hpp"
+#include "reshape.hpp"
+#include "dense.hpp"
+#include "losses.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    int failures = 0;
+    const std::string path = "checkpoint_test.ckpt";
+
+    void check(bool ok, const std::string& what) {
+        std::cout << (ok ? "ok   " : "FAIL ") << what << "\n";
+        if (!ok) {
+            failures++;
+        }
+    }
+
+    std::vector<std::shared_ptr<Layer>> make_layers() {
+        return {
+            std::make_shared<Convolutional>(std::vector<int>{2, 12, 12}, 3, 4, 1, 1),
+            std::make_shared<ReLU>(),
+            std::make_shared<MaxPooling>(2),
+            std::make_shared<Reshape>(std::vector<int>{4, 6, 6}, std::vector<int>{1, 144, 1}),
+            std::make_shared<Dense>(144, 3),
+            std::make_shared<Softmax>()
+        };
+    }
+
+    // Seeded small weights, so every run is the same and the Softmax is far from saturated
+    void initialise(Network& network, std::mt19937& gen) {
+        std::uniform_real_distribution<double> dis(-0.1, 0.1);
+        for (const auto& layer : network.get_layers()) {
+            for (Tensor* parameter : layer->parameters()) {
+                for (long i = 0; i < parameter->size(); ++i) {
+                    parameter->data()[i] = Scalar(dis(gen));
+                }
+            }
+            layer->parameters_changed();
+        }
+    }
+
+    std::string file_contents() {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    double max_difference(const Tensor& a, const Tensor& b) {
+        return (a.flat() - b.flat()).cwiseAbs().maxCoeff();
+    }
+
+    // Inference output, copied out of the network's arena
+    Tensor infer(Network& network, const Tensor& x) {
+        Network::InferenceMode inference(network);
+        return network.predict(x).clone();
+    }
+}
+
+int main() {
+    std::mt19937 gen(7);
+    std::normal_distribution<double> dis;
+    Tensor x(8, 2, 12, 12), y(8, 1, 3, 1);
+    for (long i = 0; i < x.size(); ++i) {
+        x.data()[i] = Scalar(dis(gen));
+    }
+    for (int n = 0; n < 8; ++n) {
+        y(n, 0, n % 3, 0) = 1;
+    }
+
+    // A few steps so the parameters are not just the initialisation
+    Network original(make_layers());
+    initialise(original, gen);
+    for (int step = 0; step < 3; ++step) {
+        original.train_batch(x, y, Loss::cross_entropy_loss, Loss::cross_entropy_loss_prime, 0.05);
+    }
+    Tensor expected = infer(original, x);
+    original.save(path);
+    std::string saved = file_contents();
+
+    Network loaded(make_layers());
+    loaded.load(path);
+    check(max_difference(infer(loaded, x), expected) == 0, "unfused load predicts bit-identically");
+
+    Network fused(make_layers());
+    fused.fuse();
+    fused.load(path);
+    check(max_difference(infer(fused, x), expected) < 1e-5, "fused network loads an unfused checkpoint");
+
+    // Training through the private mapping only touches this process's copy of the pages
+    Tensor dense_weights = loaded.get_layers()[4]->parameters()[0]->clone();
+    for (int step = 0; step < 3; ++step) {
+        loaded.train_batch(x, y, Loss::cross_entropy_loss, Loss::cross_entropy_loss_prime, 0.05);
+    }
+    check(max_difference(*loaded.get_layers()[4]->parameters()[0], dense_weights) > 0,
+          "training after load changes the loaded network");
+    check(file_contents() == saved, "training after load leaves the file untouched");
+    Network reloaded(make_layers());
+    reloaded.load(path);
+    check(max_difference(infer(reloaded, x), expected) == 0, "reloading gives the saved parameters back");
+
+    // And the other way: a fused network's file loads into an unfused one
+    Tensor fused_expected = infer(fused, x);
+    fused.save(path);
+    Network unfused(make_layers());
+    unfused.load(path);
+    check(max_difference(infer(unfused, x), fused_expected) < 1e-5, "unfused network loads a fused checkpoint");
+
+    std::remove(path.c_str());
+    std::cout << "\n" << (failures ? "FAILED " + std::to_string(failures) + " checks" : std::string("all passed")) << "\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+// Checks every fast convolution path against ConvAlgorithm::Direct: forward output, input
+// gradient and kernel/bias gradients, relative to the largest reference value.
+// Build and run with `make test_conv`; exits non-zero if any check fails
+#include "convolutional.hpp"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace {
+    int failures = 0;
+
+    // max |a - b| / max |reference|
+    double relative_error(const Tensor& a, const Tensor& reference) {
+        double scale = std::max<double>(reference.flat().cwiseAbs().maxCoeff(), 1e-30);
+        return (a.flat() - reference.flat()).cwiseAbs().maxCoeff() / scale;
+    }
+
+    void fill(Tensor& t, std::mt19937& gen) {
+        std::uniform_real_distribution<double> dis(-1.0, 1.0);
+        for (long i = 0; i < t.size(); ++i) {
+            t.data()[i] = Scalar(dis(gen));
+        }
+    }
+
+    struct Case {
+        int channels, height, width, kernel_size, depth, stride, padding;
+    };
+
+    // Runs one forward and backward of both layers on the same data and compares them
+    void compare(const std::string& name, const Case& c, ConvAlgorithm algorithm, int winograd_tile, double tolerance) {
+        std::mt19937 gen(42);
+        std::vector<int> input_shape = {c.channels, c.height, c.width};
+        Convolutional reference(input_shape, c.kernel_size, c.depth, c.stride, c.padding);
+        Convolutional fast(input_shape, c.kernel_size, c.depth, c.stride, c.padding);
+        reference.algorithm = ConvAlgorithm::Direct;
+        fast.algorithm = algorithm;
+        fast.winograd_tile = winograd_tile;
+        fill(reference.kernels, gen);
+        fill(reference.biases, gen);
+        fast.kernels.flat() = reference.kernels.flat();
+        fast.biases.flat() = reference.biases.flat();
+        reference.kernels_changed();
+        fast.kernels_changed();
+
+        Tensor input(2, c.channels, c.height, c.width);
+        fill(input, gen);
+        Tensor expected = reference.forward(input).clone();
+        Tensor output = fast.forward(input).clone();
+        Tensor output_gradient(expected.shape());
+        fill(output_gradient, gen);
+        Tensor expected_gradient = reference.backward(output_gradient).clone();
+        Tensor input_gradient = fast.backward(output_gradient).clone();
+
+        double errors[4] = {
+            relative_error(output, expected),
+            relative_error(input_gradient, expected_gradient),
+            relative_error(*fast.gradients()[0], *reference.gradients()[0]),
+            relative_error(*fast.gradients()[1], *reference.gradients()[1]),
+        };
+        const char* parts[4] = {"forward", "input gradient", "kernel gradient", "bias gradient"};
+        for (int i = 0; i < 4; ++i) {
+            bool ok = errors[i] <= tolerance;
+            if (!ok) {
+                failures++;
+            }
+            std::cout << (ok ? "ok   " : "FAIL ") << name << " " << c.channels << "x" << c.height << "x" << c.width
+                      << " k" << c.kernel_size << " s" << c.stride << " p" << c.padding << " " << parts[i]
+                      << ": " << errors[i] << " (tolerance " << tolerance << ")\n";
+        }
+    }
+
+    void test_winograd() {
+        std::cout << "\n=== Winograd vs Direct ===\n";
+        const bool single = std::is_same<Scalar, float>::value;
+        // Tolerances from winograd.hpp
+        const double tile2 = single ? 1e-6 : 1e-15;
+        const double tile4 = single ? 1e-5 : 1e-14;
+        std::vector<Case> cases = {
+            {3, 8, 8, 3, 4, 1, 1},
+            {2, 13, 10, 3, 5, 1, 0},
+            {4, 11, 17, 3, 3, 1, 2},
+            {2, 3, 3, 3, 2, 1, 1},  // Smaller than one output tile
+        };
+        for (const Case& c : cases) {
+            compare("F(2x2,3x3)", c, ConvAlgorithm::Winograd, 2, tile2);
+            compare("F(4x4,3x3)", c, ConvAlgorithm::Winograd, 4, tile4);
+        }
+    }
+
+    void test_fft() {
+        std::cout << "\n=== FFT vs Direct ===\n";
+        const double tolerance = std::is_same<Scalar, float>::value ? 1e-5 : 1e-13;
+        std::vector<Case> cases = {
+            {2, 16, 16, 7, 3, 1, 3},
+            {2, 13, 12, 7, 3, 1, 2},  // Padded plane taller than wide
+            {3, 9, 21, 5, 4, 1, 0},   // Wider than tall
+            {2, 20, 14, 7, 2, 2, 3},
+            {1, 11, 18, 5, 3, 3, 1},
+            {2, 12, 7, 3, 2, 2, 0},
+        };
+        for (const Case& c : cases) {
+            compare("FFT", c, ConvAlgorithm::FFT, 4, tolerance);
+        }
+    }
+}
+
+int main() {
+    std::cout << std::scientific;
+    test_winograd();
+    test_fft();
+    std::cout << "\n" << (failures ? "FAILED " + std::to_string(failures) + " checks" : std::string("all passed")) << "\n";
+    return failures ? 1 : 0;
+}
@@ -1,12 +1,25 @@
 #include "convolutional.hpp"
+#include "thread_pool.hpp"
+#include "winograd.hpp"
 #include <iostream>
 #include <vector>
 #include <random>
+#include <algorithm>
 #include <Eigen/Dense>
 
 using namespace std;
 using namespace Eigen;
 
+namespace {
+    // thread_scratch tags for the per-task spectrum sums and kernel gradient planes of the FFT path
+    struct SpectrumSum {};
+    struct KernelGradientPlane {};
+
+    Eigen::Map<Convolutional::SpectrumMatrix> spectrum_sum(long size) {
+        return Eigen::Map<Convolutional::SpectrumMatrix>(thread_scratch<FFT::Complex, SpectrumSum>(size), 1, size);
+    }
+}
+
 Convolutional::Convolutional(const std::vector<int>& input_shape, int kernel_size, int depth, 
                           int stride, int padding)
     : depth(depth), kernel_size(kernel_size), stride(stride), padding(padding), gen(rd()) {
@@ -18,36 +31,38 @@ Convolutional::Convolutional(const std::vector<int>& input_shape, int kernel_siz
     output_height = (input_height + 2 * padding - kernel_size) / stride + 1;
     output_width = (input_width + 2 * padding - kernel_size) / stride + 1;
 
-    // Resize containers
-    kernels.resize(depth, vector<MatrixXd>(input_depth, MatrixXd(kernel_size, kernel_size)));
-    biases.resize(depth, MatrixXd(output_height, output_width));
+    // Allocate parameters
+    kernels = Tensor(depth, input_depth, kernel_size, kernel_size);
+    biases = Tensor(1, depth, output_height, output_width);
+    kernels_gradient = Tensor(kernels.shape());
+    biases_gradient = Tensor(biases.shape());
 
     // Initialize kernels and biases with random values
-    std::normal_distribution<double> dist(0.0, 1.0);
+    std::normal_distribution<Scalar> dist(0.0, 1.0);
     for (int i = 0; i < depth; ++i) {
         for (int j = 0; j < input_depth; ++j) {
             for (int k = 0; k < kernel_size; ++k) {
                 for (int l = 0; l < kernel_size; ++l) {
-                    kernels[i][j](k, l) = dist(gen);
+                    kernels(i, j, k, l) = dist(gen);
                 }
             }
         }
         for (int k = 0; k < output_height; ++k) {
             for (int l = 0; l < output_width; ++l) {
-                biases[i](k, l) = dist(gen);
+                biases(0, i, k, l) = dist(gen);
             }
         }
     }
 }
 
-Eigen::MatrixXd Convolutional::padInput(const Eigen::MatrixXd& input) const {
+MatrixXs Convolutional::padInput(const MatrixXs& input) const {
     if (padding == 0) {
         return input;
     }
     
     int padded_height = input.rows() + 2 * padding;
     int padded_width = input.cols() + 2 * padding;
-    Eigen::MatrixXd padded = Eigen::MatrixXd::Zero(padded_height, padded_width);
+    MatrixXs padded = MatrixXs::Zero(padded_height, padded_width);
     
     // Copy the input to the center of the padded matrix
     padded.block(padding, padding, input.rows(), input.cols()) = input;
@@ -55,105 +70,456 @@ Eigen::MatrixXd Convolutional::padInput(const Eigen::MatrixXd& input) const {
     return padded;
 }
 
-std::vector<Eigen::MatrixXd> Convolutional::forward(const std::vector<Eigen::MatrixXd>& input) {
+void Convolutional::im2col(const Tensor& input, int n, int j) {
+    const int out_size = output_height * output_width;
+    auto in = input.channel(n, j);
+    for (int k = 0; k < kernel_size; ++k) {
+        for (int l = 0; l < kernel_size; ++l) {
+            // Row (j, k, l) holds the input pixel under kernel tap (k, l) for every output position
+            Scalar* row = columns.data() + ((long)n * patch_size() + (j * kernel_size + k) * kernel_size + l) * out_size;
+            for (int m = 0; m < output_height; ++m) {
+                int input_row = m * stride + k - padding;
+                for (int o = 0; o < output_width; ++o) {
+                    int input_col = o * stride + l - padding;
+                    bool inside = input_row >= 0 && input_row < input_height &&
+                                  input_col >= 0 && input_col < input_width;
+                    row[m * output_width + o] = inside ? in(input_row, input_col) : Scalar(0);
+                }
+            }
+        }
+    }
+}
+
+void Convolutional::im2col(const Tensor& input) {
+    // Every (sample, channel) pair owns its own rows of the buffer
+    ThreadPool::global().parallel_for(0, input.batch() * input_depth, [&](int task) {
+        im2col(input, task / input_depth, task % input_depth);
+    });
+}
+
+void Convolutional::lower(const Tensor& input) {
+    if (training) {
+        this->input = input;
+    }
+    input_spectra_valid = false;
+    columns.resize((long)input.batch() * patch_size(), output_height * output_width);
+    columns_valid = training;
+    im2col(input);
+}
+
+int Convolutional::filter_blocks(int batch) const {
+    // Enough blocks that batch * blocks covers the pool, but never more than one filter per block
+    int threads = ThreadPool::global().num_threads();
+    return std::max(1, std::min(depth, (threads + batch - 1) / batch));
+}
+
+std::shared_ptr<Layer> Convolutional::clone() const {
+    auto copy = std::make_shared<Convolutional>(std::vector<int>{input_depth, input_height, input_width},
+                                                kernel_size, depth, stride, padding);
+    copy->algorithm = algorithm;
+    copy->winograd_tile = winograd_tile;
+    copy->fft_kernel_threshold = fft_kernel_threshold;
+    copy->kernels = kernels;
+    copy->biases = biases;
+    return copy;
+}
+
+void Convolutional::set_training(bool training) {
+    Layer::set_training(training);
+    if (!training) {
+        // Both are rebuilt by the next forward, which only needs them as scratch
+        columns.resize(0, 0);
+        input_spectra.resize(0, 0);
+        columns_valid = false;
+        input_spectra_valid = false;
+    }
+}
+
+ConvAlgorithm Convolutional::resolved_algorithm() const {
+    // The input gradient runs Winograd with padding kernel_size - 1 - padding, so that has to stay non-negative
+    bool winograd_fits = kernel_size == 3 && stride == 1 && padding <= 2 && Winograd::supported_tile(winograd_tile);
+    switch (algorithm) {
+        case ConvAlgorithm::Direct:
+            return ConvAlgorithm::Direct;
+        case ConvAlgorithm::Winograd:
+            return winograd_fits ? ConvAlgorithm::Winograd : ConvAlgorithm::Im2col;
+        case ConvAlgorithm::FFT:
+            return ConvAlgorithm::FFT;
+        case ConvAlgorithm::Auto:
+            if (winograd_fits) {
+                return ConvAlgorithm::Winograd;
+            }
+            return kernel_size >= fft_kernel_threshold ? ConvAlgorithm::FFT : ConvAlgorithm::Im2col;
+        default:
+            return ConvAlgorithm::Im2col;
+    }
+}
+
+void Convolutional::kernels_changed() {
+    winograd_filters_valid = false;
+    kernel_spectra_valid = false;
+}
+
+Tensor Convolutional::forward(const Tensor& input) {
     // Store input for backward pass
-    this->input = input;
+    if (training) {
+        this->input = input;
+    }
+    // Whichever path runs re-marks the cache it fills for backward
+    columns_valid = false;
+    input_spectra_valid = false;
 
-    // Initialize output vector
-    std::vector<Eigen::MatrixXd> output(depth, MatrixXd::Zero(output_height, output_width));
+    Tensor output;
+    switch (resolved_algorithm()) {
+        case ConvAlgorithm::Direct: output = forward_direct(input); break;
+        case ConvAlgorithm::Winograd: output = forward_winograd(input); break;
+        case ConvAlgorithm::FFT: output = forward_fft(input); break;
+        default: output = forward_im2col(input); break;
+    }
+    return output;
+}
 
-    for (int i = 0; i < depth; ++i) {
-        for (int j = 0; j < input_depth; ++j) {
-            // Apply padding to input
-            MatrixXd padded_input = padInput(input[j]);
-            
-            for (int k = 0; k < output_height; ++k) {
-                for (int l = 0; l < output_width; ++l) {
-                    // Extract patch from padded input based on stride
-                    MatrixXd patch = padded_input.block(k * stride, l * stride, kernel_size, kernel_size);
-                    // Element-wise multiplication and sum (dot product)
-                    output[i](k, l) += (patch.array() * kernels[i][j].array()).sum();
+Tensor Convolutional::forward_im2col(const Tensor& input) {
+    const int out_size = output_height * output_width;
+    Tensor output = make_output(output_shape(input.shape()));
+    columns.resize((long)input.batch() * patch_size(), out_size);
+    columns_valid = training;
+
+    im2col(input);
+
+    auto filters = kernels.matrix(depth, patch_size());
+    auto bias = biases.matrix(depth, out_size);
+    // Split over samples and, when the batch is smaller than the pool, over blocks of filters
+    int blocks = filter_blocks(input.batch());
+    ThreadPool::global().parallel_for(0, input.batch() * blocks, [&](int task) {
+        int n = task / blocks;
+        int first = (long)depth * (task % blocks) / blocks;
+        int count = (long)depth * (task % blocks + 1) / blocks - first;
+
+        // (depth x patch) * (patch x out_size) gives every output channel of this sample at once
+        Tensor::MatrixMap out(output.data() + n * output.sample_size(), depth, out_size);
+        out.middleRows(first, count).noalias() =
+            filters.middleRows(first, count) * columns.middleRows((long)n * patch_size(), patch_size());
+        out.middleRows(first, count) += bias.middleRows(first, count);
+    });
+    return output;
+}
+
+void Convolutional::update_winograd_filters() {
+    if (winograd_filters_valid) {
+        return;
+    }
+    Winograd::transform_filters(winograd_tile, kernels, false, winograd_filters);
+    Winograd::transform_filters(winograd_tile, kernels, true, winograd_filters_flipped);
+    winograd_filters_valid = true;
+}
+
+Tensor Convolutional::forward_winograd(const Tensor& input) {
+    update_winograd_filters();
+
+    Tensor output = make_output(output_shape(input.shape()));
+    Winograd::convolve(winograd_tile, winograd_filters, input, padding, output, winograd_workspace);
+
+    const int out_size = output_height * output_width;
+    auto bias = biases.matrix(depth, out_size);
+    ThreadPool::global().parallel_for(0, input.batch(), [&](int n) {
+        Tensor::MatrixMap(output.data() + n * output.sample_size(), depth, out_size) += bias;
+    });
+    return output;
+}
+
+void Convolutional::update_kernel_spectra() {
+    if (kernel_spectra_valid) {
+        return;
+    }
+    // Big enough that the correlation of the padded input never wraps around
+    if (!fft_plan) {
+        fft_plan = std::make_shared<FFT::Plan2D>(FFT::next_power_of_two(input_height + 2 * padding),
+                                                 FFT::next_power_of_two(input_width + 2 * padding));
+    }
+    kernel_spectra.resize((long)depth * input_depth, fft_plan->spectrum_size());
+    ThreadPool::global().parallel_for(0, depth * input_depth, [&](int task) {
+        fft_plan->forward(kernels.channel(task / input_depth, task % input_depth).data(), kernel_size, kernel_size, 0, 1,
+                          kernel_spectra.row(task).data());
+    });
+    kernel_spectra_valid = true;
+}
+
+void Convolutional::transform_input(const Tensor& input) {
+    input_spectra.resize((long)input.batch() * input_depth, fft_plan->spectrum_size());
+    ThreadPool::global().parallel_for(0, input.batch() * input_depth, [&](int task) {
+        fft_plan->forward(input.channel(task / input_depth, task % input_depth).data(), input_height, input_width, padding, 1,
+                          input_spectra.row(task).data());
+    });
+    input_spectra_valid = training;
+}
+
+Tensor Convolutional::forward_fft(const Tensor& input) {
+    update_kernel_spectra();
+    transform_input(input);
+
+    // Correlation is X * conj(K) summed over channels, then one inverse transform per
+    // output channel, read back every stride-th position
+    Tensor output = make_output(output_shape(input.shape()));
+    ThreadPool::global().parallel_for(0, input.batch() * depth, [&](int task) {
+        int n = task / depth;
+        int i = task % depth;
+        auto sum = spectrum_sum(fft_plan->spectrum_size());
+        sum = input_spectra.row((long)n * input_depth).cwiseProduct(kernel_spectra.row((long)i * input_depth).conjugate());
+        for (int j = 1; j < input_depth; ++j) {
+            sum += input_spectra.row((long)n * input_depth + j).cwiseProduct(kernel_spectra.row((long)i * input_depth + j).conjugate());
+        }
+        fft_plan->inverse(sum.data(), output.channel(n, i).data(), output_height, output_width, 0, stride);
+        output.channel(n, i) += biases.channel(0, i);
+    });
+    return output;
+}
+
+Tensor Convolutional::forward_direct(const Tensor& input) {
+    // Initialize output tensor
+    Tensor output = make_output(output_shape(input.shape()));
+
+    for (int n = 0; n < input.batch(); ++n) {
+        for (int i = 0; i < depth; ++i) {
+            auto out = output.channel(n, i);
+            for (int j = 0; j < input_depth; ++j) {
+                // Apply padding to input
+                MatrixXs padded_input = padInput(input.channel(n, j));
+                
+                for (int k = 0; k < output_height; ++k) {
+                    for (int l = 0; l < output_width; ++l) {
+                        // Extract patch from padded input based on stride
+                        MatrixXs patch = padded_input.block(k * stride, l * stride, kernel_size, kernel_size);
+                        // Element-wise multiplication and sum (dot product)
+                        out(k, l) += (patch.array() * kernels.channel(i, j).array()).sum();
+                    }
                 }
             }
+            out += biases.channel(0, i); // Add biases
         }
-        output[i] += biases[i]; // Add biases
     }
 
-    // Store output for backward pass
-    this->output = output;
-    // std::cout << "Channels " << output.size() << " Height " << output[0].rows() << " Width " << output[0].cols() << std::endl;
     return output;
 }
 
-std::vector<Eigen::MatrixXd> Convolutional::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    // Initialize gradients
-    std::vector<std::vector<Eigen::MatrixXd>> kernels_gradient(depth, std::vector<Eigen::MatrixXd>(input_depth, MatrixXd::Zero(kernel_size, kernel_size)));
-    std::vector<Eigen::MatrixXd> input_gradient(input_depth, MatrixXd::Zero(input_height, input_width));
-
-    // Calculate gradients for kernels
-    for (int i = 0; i < depth; ++i) {
-        for (int j = 0; j < input_depth; ++j) {
-            // Apply padding to input
-            MatrixXd padded_input = padInput(input[j]);
-            
-            for (int k = 0; k < kernel_size; ++k) {
-                for (int l = 0; l < kernel_size; ++l) {
-                    double grad = 0.0;
-                    for (int m = 0; m < output_height; ++m) {
-                        for (int n = 0; n < output_width; ++n) {
-                            // For each output position, multiply the corresponding input patch
-                            // with the output gradient at that position
-                            int input_row = m * stride + k;
-                            int input_col = n * stride + l;
-                            if (input_row >= 0 && input_row < padded_input.rows() &&
-                                input_col >= 0 && input_col < padded_input.cols()) {
-                                grad += padded_input(input_row, input_col) * output_gradient[i](m, n);
-                            }
-                        }
+void Convolutional::col2im(const Scalar* column_gradient, Tensor& input_gradient, int n, int j) const {
+    const int out_size = output_height * output_width;
+    auto grad_in = input_gradient.channel(n, j);
+    for (int k = 0; k < kernel_size; ++k) {
+        for (int l = 0; l < kernel_size; ++l) {
+            // Scatter row (k, l) back onto the input pixels it was gathered from
+            const Scalar* row = column_gradient + (k * kernel_size + l) * out_size;
+            for (int m = 0; m < output_height; ++m) {
+                int input_row = m * stride + k - padding;
+                if (input_row < 0 || input_row >= input_height) {
+                    continue;
+                }
+                for (int o = 0; o < output_width; ++o) {
+                    int input_col = o * stride + l - padding;
+                    if (input_col >= 0 && input_col < input_width) {
+                        grad_in(input_row, input_col) += row[m * output_width + o];
                     }
-                    kernels_gradient[i][j](k, l) = grad;
                 }
             }
         }
     }
+}
+
+Tensor Convolutional::backward(const Tensor& output_gradient) {
+    // Every path adds into kernels_gradient and biases_gradient, see Layer::backward
+    Tensor input_gradient;
+    switch (resolved_algorithm()) {
+        case ConvAlgorithm::Direct:
+            input_gradient = backward_direct(output_gradient, kernels_gradient, biases_gradient);
+            break;
+        case ConvAlgorithm::Winograd:
+            input_gradient = backward_winograd(output_gradient, kernels_gradient, biases_gradient);
+            break;
+        case ConvAlgorithm::FFT:
+            input_gradient = backward_fft(output_gradient, kernels_gradient, biases_gradient);
+            break;
+        default:
+            input_gradient = backward_im2col(output_gradient, kernels_gradient, biases_gradient);
+            break;
+    }
 
-    // Calculate gradients for inputs
-    for (int j = 0; j < input_depth; ++j) {
-        // Create padded input gradient
-        MatrixXd padded_input_gradient = MatrixXd::Zero(input_height + 2 * padding, input_width + 2 * padding);
-        
+    return input_gradient;
+}
+
+Tensor Convolutional::backward_im2col(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient) {
+    parameter_gradients_im2col(output_gradient, kernels_gradient, biases_gradient);
+    return input_gradient_im2col(output_gradient);
+}
+
+Tensor Convolutional::backward_winograd(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient) {
+    // The kernel gradient is a correlation with an output-sized "filter", which Winograd
+    // tiles cannot express, so it stays a GEMM over freshly lowered columns
+    parameter_gradients_im2col(output_gradient, kernels_gradient, biases_gradient);
+
+    // dX is dY zero-padded by kernel_size - 1 - padding, convolved with the flipped, transposed kernels
+    update_winograd_filters();
+    Tensor input_gradient = make_input_gradient(input.shape());
+    Winograd::convolve(winograd_tile, winograd_filters_flipped, output_gradient, kernel_size - 1 - padding, input_gradient,
+                       winograd_gradient_workspace);
+    return input_gradient;
+}
+
+Tensor Convolutional::backward_fft(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient) {
+    update_kernel_spectra();
+    bool reuse_spectra = input_spectra_valid && input_spectra.rows() == (long)input.batch() * input_depth;
+    if (!reuse_spectra) {
+        transform_input(input);
+    }
+
+    // dY spread back out to input resolution (every stride-th position) before transforming
+    gradient_spectra.resize((long)input.batch() * depth, fft_plan->spectrum_size());
+    ThreadPool::global().parallel_for(0, input.batch() * depth, [&](int task) {
+        fft_plan->forward(output_gradient.channel(task / depth, task % depth).data(), output_height, output_width, 0, stride,
+                          gradient_spectra.row(task).data());
+    });
+
+    // dX = sum over filters of dY convolved (not correlated) with K, cropped back to the unpadded input
+    Tensor input_gradient = make_input_gradient(input.shape());
+    ThreadPool::global().parallel_for(0, input.batch() * input_depth, [&](int task) {
+        int n = task / input_depth;
+        int j = task % input_depth;
+        auto sum = spectrum_sum(fft_plan->spectrum_size());
+        sum = gradient_spectra.row((long)n * depth).cwiseProduct(kernel_spectra.row(j));
+        for (int i = 1; i < depth; ++i) {
+            sum += gradient_spectra.row((long)n * depth + i).cwiseProduct(kernel_spectra.row((long)i * input_depth + j));
+        }
+        fft_plan->inverse(sum.data(), input_gradient.channel(n, j).data(), input_height, input_width, padding, 1);
+    });
+
+    // dK = sum over samples of the padded input correlated with dY, the first kernel_size x kernel_size lags
+    ThreadPool::global().parallel_for(0, depth * input_depth, [&](int task) {
+        int i = task / input_depth;
+        int j = task % input_depth;
+        auto sum = spectrum_sum(fft_plan->spectrum_size());
+        sum = input_spectra.row(j).cwiseProduct(gradient_spectra.row(i).conjugate());
+        for (int n = 1; n < input.batch(); ++n) {
+            sum += input_spectra.row((long)n * input_depth + j).cwiseProduct(gradient_spectra.row((long)n * depth + i).conjugate());
+        }
+        Scalar* plane = thread_scratch<Scalar, KernelGradientPlane>((long)kernel_size * kernel_size);
+        fft_plan->inverse(sum.data(), plane, kernel_size, kernel_size, 0, 1);
+        kernels_gradient.channel(i, j) += Tensor::ConstMatrixMap(plane, kernel_size, kernel_size);
+    });
+
+    for (int n = 0; n < input.batch(); ++n) {
+        biases_gradient.flat() += output_gradient.sample(n).flat();
+    }
+    return input_gradient;
+}
+
+void Convolutional::parameter_gradients_im2col(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient) {
+    const int out_size = output_height * output_width;
+
+    // The forward pass leaves every sample's columns in the buffer, so only re-lower when they are gone
+    bool reuse_columns = columns_valid && columns.rows() == (long)input.batch() * patch_size();
+    if (!reuse_columns) {
+        columns.resize((long)input.batch() * patch_size(), out_size);
+        im2col(input);
+    }
+
+    auto filters_gradient = kernels_gradient.matrix(depth, patch_size());
+    auto bias_gradient = biases_gradient.matrix(depth, out_size);
+
+    // dK = sum over samples of dY * im2col(X)^T. Each task owns a block of filter rows
+    // and sums every sample into it, so the reduction needs no locks and is deterministic
+    int blocks = std::min(depth, ThreadPool::global().num_threads());
+    ThreadPool::global().parallel_for(0, blocks, [&](int block) {
+        int first = (long)depth * block / blocks;
+        int count = (long)depth * (block + 1) / blocks - first;
+        for (int n = 0; n < input.batch(); ++n) {
+            Tensor::ConstMatrixMap grad(output_gradient.data() + n * output_gradient.sample_size(), depth, out_size);
+            filters_gradient.middleRows(first, count).noalias() +=
+                grad.middleRows(first, count) * columns.middleRows((long)n * patch_size(), patch_size()).transpose();
+            bias_gradient.middleRows(first, count) += grad.middleRows(first, count);
+        }
+    });
+}
+
+Tensor Convolutional::input_gradient_im2col(const Tensor& output_gradient) {
+    const int out_size = output_height * output_width;
+    Tensor input_gradient = make_input_gradient(input.shape());
+    auto filters = kernels.matrix(depth, patch_size());
+
+    // dX = col2im(K^T * dY), split over (sample, input channel) since each pair writes its own plane.
+    // The kernel gradient is done with the columns by now, so each pair's column gradient
+    // goes into the very rows it was lowered to
+    const int taps = kernel_size * kernel_size;
+    ThreadPool::global().parallel_for(0, input.batch() * input_depth, [&](int task) {
+        int n = task / input_depth;
+        int j = task % input_depth;
+        Tensor::ConstMatrixMap grad(output_gradient.data() + n * output_gradient.sample_size(), depth, out_size);
+        auto column_gradient = columns.middleRows((long)n * patch_size() + j * taps, taps);
+        column_gradient.noalias() = filters.middleCols(j * taps, taps).transpose() * grad;
+        col2im(column_gradient.data(), input_gradient, n, j);
+    });
+    columns_valid = false;
+
+    return input_gradient;
+}
+
+Tensor Convolutional::backward_direct(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient) {
+    Tensor input_gradient = make_input_gradient(input.shape());
+
+    for (int n = 0; n < input.batch(); ++n) {
+        // Calculate gradients for kernels
         for (int i = 0; i < depth; ++i) {
-            for (int m = 0; m < output_height; ++m) {
-                for (int n = 0; n < output_width; ++n) {
-                    // For each position in the output gradient
-                    for (int k = 0; k < kernel_size; ++k) {
-                        for (int l = 0; l < kernel_size; ++l) {
-                            int input_row = m * stride + k;
-                            int input_col = n * stride + l;
-                            padded_input_gradient(input_row, input_col) += 
-                                kernels[i][j](k, l) * output_gradient[i](m, n);
+            auto out_grad = output_gradient.channel(n, i);
+            for (int j = 0; j < input_depth; ++j) {
+                // Apply padding to input
+                MatrixXs padded_input = padInput(input.channel(n, j));
+                
+                for (int k = 0; k < kernel_size; ++k) {
+                    for (int l = 0; l < kernel_size; ++l) {
+                        Scalar grad = 0;
+                        for (int m = 0; m < output_height; ++m) {
+                            for (int o = 0; o < output_width; ++o) {
+                                // For each output position, multiply the corresponding input patch
+                                // with the output gradient at that position
+                                int input_row = m * stride + k;
+                                int input_col = o * stride + l;
+                                if (input_row >= 0 && input_row < padded_input.rows() &&
+                                    input_col >= 0 && input_col < padded_input.cols()) {
+                                    grad += padded_input(input_row, input_col) * out_grad(m, o);
+                                }
+                            }
                         }
+                        kernels_gradient(i, j, k, l) += grad;
                     }
                 }
             }
+            biases_gradient.channel(0, i) += out_grad;
         }
-        
-        // Extract the actual input gradient from the padded version
-        if (padding > 0) {
-            input_gradient[j] = padded_input_gradient.block(padding, padding, input_height, input_width);
-        } else {
-            input_gradient[j] = padded_input_gradient;
-        }
-    }
 
-    // Update kernels and biases
-    for (int i = 0; i < depth; ++i) {
+        // Calculate gradients for inputs
         for (int j = 0; j < input_depth; ++j) {
-            kernels[i][j] -= learning_rate * kernels_gradient[i][j];
+            // Create padded input gradient
+            MatrixXs padded_input_gradient = MatrixXs::Zero(input_height + 2 * padding, input_width + 2 * padding);
+            
+            for (int i = 0; i < depth; ++i) {
+                auto out_grad = output_gradient.channel(n, i);
+                for (int m = 0; m < output_height; ++m) {
+                    for (int o = 0; o < output_width; ++o) {
+                        // For each position in the output gradient
+                        for (int k = 0; k < kernel_size; ++k) {
+                            for (int l = 0; l < kernel_size; ++l) {
+                                int input_row = m * stride + k;
+                                int input_col = o * stride + l;
+                                padded_input_gradient(input_row, input_col) += 
+                                    kernels(i, j, k, l) * out_grad(m, o);
+                            }
+                        }
+                    }
+                }
+            }
+            
+            // Extract the actual input gradient from the padded version
+            input_gradient.channel(n, j) = padded_input_gradient.block(padding, padding, input_height, input_width);
         }
-        biases[i] -= learning_rate * output_gradient[i];
     }
 
-    // std::cout << "Channels " << input_gradient.size() << " Height " << input_gradient[0].rows() << " Width " << input_gradient[0].cols() << std::endl;
     return input_gradient;
 }
\ No newline at end of file
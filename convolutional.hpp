@@ -1,9 +1,22 @@
 #pragma once
 #include "layer.hpp"
+#include "fft.hpp"
+#include "winograd.hpp"
+#include <memory>
 #include <vector>
 #include <random>
 #include <Eigen/Dense>
 
+// How Convolutional::forward computes its output.
+// Everything but Direct runs on ThreadPool::global(), see ThreadPool::set_num_threads()
+enum class ConvAlgorithm {
+    Direct,    // Reference sliding-window loop, one patch at a time
+    Im2col,    // Lower each sample to a column matrix and compute all filters with one GEMM
+    Winograd,  // F(m x m, 3 x 3) minimal filtering, stride-1 3x3 layers only (see winograd.hpp)
+    FFT,       // Pointwise products of 2D spectra, for large kernels on large feature maps
+    Auto,      // Winograd where it applies, FFT from fft_kernel_threshold up, Im2col otherwise
+};
+
 class Convolutional : public Layer {
 public:
     // Constructor
@@ -15,8 +28,18 @@ public:
                     );
 
     // Forward and backward pass
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "Convolutional"; }
+    // Inference mode also releases the im2col and input spectrum buffers
+    void set_training(bool training) override;
+    Tensor::Shape output_shape(const Tensor::Shape& input_shape) const override {
+        return {input_shape[0], depth, output_height, output_width};
+    }
+    std::vector<Tensor*> parameters() override { return {&kernels, &biases}; }
+    std::vector<Tensor*> gradients() override { return {&kernels_gradient, &biases_gradient}; }
+    std::shared_ptr<Layer> clone() const override;
+    void parameters_changed() override { kernels_changed(); }
 
 public: 
     // Layer parameters
@@ -29,17 +52,85 @@ public:
     int padding;
     int output_height;
     int output_width;
+    ConvAlgorithm algorithm = ConvAlgorithm::Auto;
+    // Output tile of the Winograd path: 4 for F(4x4, 3x3), or 2 for the slower but more accurate F(2x2, 3x3)
+    int winograd_tile = 4;
+    // Smallest kernel for which Auto switches to the FFT path
+    int fft_kernel_threshold = 7;
 
     // Kernels and biases
     // [number of feature maps/filters][number of channels in image][<access elements of kernel>]
-    std::vector<std::vector<Eigen::MatrixXd>> kernels; // [depth][input_depth][kernel_size x kernel_size]
+    // Stored contiguously, so kernels.matrix(depth, input_depth * kernel_size * kernel_size)
+    // is the flattened filter bank with one filter per row
+    Tensor kernels; // (depth, input_depth, kernel_size, kernel_size)
     // Common across all channels of image, so drop 2nd dimension. Depth - number of output feature maps(or the number of filters that will be learned across the images)
-    std::vector<Eigen::MatrixXd> biases; // [depth][output_height x output_width]
+    Tensor biases; // (1, depth, output_height, output_width)
+
+    // im2col buffer: for every sample, (input_depth * kernel_size * kernel_size) rows of
+    // (output_height * output_width) columns, stacked sample after sample
+    Tensor::Matrix columns;
+    // True while columns holds the lowering of the cached input
+    bool columns_valid = false;
+
+    // Winograd-transformed kernels for forward, and of the flipped kernels for the input gradient.
+    // Kept across calls and rebuilt after backward updates the kernels
+    Tensor::Matrix winograd_filters;
+    Tensor::Matrix winograd_filters_flipped;
+    bool winograd_filters_valid = false;
+
+    // FFT path: one half spectrum per row, sized by fft_plan to fit the padded input
+    using SpectrumMatrix = Eigen::Matrix<FFT::Complex, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+    std::shared_ptr<const FFT::Plan2D> fft_plan;
+    SpectrumMatrix kernel_spectra; // row (i * input_depth + j) for filter i, channel j
+    bool kernel_spectra_valid = false;
+    SpectrumMatrix input_spectra;  // row (n * input_depth + j) for sample n, channel j
+    // True while input_spectra holds the transform of the cached input
+    bool input_spectra_valid = false;
 
     // Random number generation
     std::random_device rd;
     std::mt19937 gen;
 
     // Helper methods
-    Eigen::MatrixXd padInput(const Eigen::MatrixXd& input) const;
+    MatrixXs padInput(const MatrixXs& input) const;
+    int patch_size() const { return input_depth * kernel_size * kernel_size; }
+    // Lowers channel j of sample n into its rows of the columns buffer
+    void im2col(const Tensor& input, int n, int j);
+    // Lowers the whole batch, in parallel over (sample, channel)
+    void im2col(const Tensor& input);
+    // Inverse of im2col for one (sample, channel): accumulates its kernel_size^2 column rows into input_gradient
+    void col2im(const Scalar* column_gradient, Tensor& input_gradient, int n, int j) const;
+    // The first half of an Im2col forward: caches input and fills columns for backward,
+    // leaving the GEMM to the caller (FusedConvReLUPool)
+    void lower(const Tensor& input);
+    // Number of filter blocks each sample's GEMM is split into across the thread pool
+    int filter_blocks(int batch) const;
+    // Drops every cached transform of the kernels; call after writing to kernels directly
+    void kernels_changed();
+    // The algorithm that actually runs: resolves Auto and falls back from Winograd where it does not apply
+    ConvAlgorithm resolved_algorithm() const;
+
+private:
+    // Backward's parameter gradients (see gradients()) and transform intermediates, kept so
+    // steady-state training reuses their storage (the Direct path still allocates, it is only a reference)
+    Tensor kernels_gradient;
+    Tensor biases_gradient;
+    Winograd::Workspace winograd_workspace;
+    Winograd::Workspace winograd_gradient_workspace;
+    SpectrumMatrix gradient_spectra;  // row (n * depth + i) for sample n, filter i
+
+    Tensor forward_direct(const Tensor& input);
+    Tensor forward_im2col(const Tensor& input);
+    Tensor forward_winograd(const Tensor& input);
+    Tensor forward_fft(const Tensor& input);
+    Tensor backward_direct(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient);
+    Tensor backward_im2col(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient);
+    Tensor backward_winograd(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient);
+    Tensor backward_fft(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient);
+    // Pieces of the GEMM backward shared by the im2col and Winograd paths
+    void parameter_gradients_im2col(const Tensor& output_gradient, Tensor& kernels_gradient, Tensor& biases_gradient);
+    Tensor input_gradient_im2col(const Tensor& output_gradient);
+    void update_winograd_filters();
+    void update_kernel_spectra();
+    void transform_input(const Tensor& input);
 };
\ No newline at end of file
@@ -1,4 +1,15 @@
 #include "dataloader.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
 // using namespace std;
 namespace fs = std::filesystem;
 
@@ -14,115 +25,343 @@ ImageFolder::~ImageFolder()
 	// }
 }
 
-using ImageChannels = std::vector<Eigen::MatrixXd>;
-using ImagePtr = std::shared_ptr<ImageChannels>;
+namespace {
+	// Decoded-image cache, see ImageFolder. Layout (native byte order):
+	//   magic "NNIMGC\0\0", version, entry count
+	//   per entry: path relative to the root, label, source mtime and size,
+	//              channels/width/height (channels == 0 when decoding failed), pixel offset
+	//   pixels: raw interleaved uint8, exactly as stb_image returns them, 64-byte aligned
+	const char cache_magic[8] = {'N', 'N', 'I', 'M', 'G', 'C', '\0', '\0'};
+	constexpr std::uint32_t cache_version = 1;
 
-std::vector<Eigen::MatrixXd> ImageFolder::raw_img_to_matrix(unsigned char* raw_img, int channels, int width, int height)
+	struct CacheEntry {
+		std::string label;
+		std::int64_t mtime = 0;
+		std::uint64_t file_size = 0;
+		std::int32_t channels = 0, width = 0, height = 0;
+		const unsigned char* pixels = nullptr; // Into the mapping
+	};
+
+	std::uint64_t align64(std::uint64_t n) {
+		return (n + 63) / 64 * 64;
+	}
+
+	std::uint64_t pixel_bytes(std::int32_t channels, std::int32_t width, std::int32_t height) {
+		return static_cast<std::uint64_t>(channels) * width * height;
+	}
+
+	// Entries by relative path. Anything unreadable, truncated or from another version counts as no cache
+	std::unordered_map<std::string, CacheEntry> read_cache(const std::string& cache_path, std::shared_ptr<MappedFile>& file)
+	{
+		std::unordered_map<std::string, CacheEntry> entries;
+		if (!fs::exists(cache_path)) {
+			return entries;
+		}
+		try {
+			file = std::make_shared<MappedFile>(cache_path);
+			MappedReader reader(*file);
+			char magic[8];
+			for (char& c : magic) {
+				c = reader.read<char>();
+			}
+			if (std::memcmp(magic, cache_magic, sizeof(magic)) != 0 || reader.read<std::uint32_t>() != cache_version) {
+				return {};
+			}
+			std::uint32_t count = reader.read<std::uint32_t>();
+			for (std::uint32_t i = 0; i < count; i++) {
+				std::string path = reader.read_string(reader.read<std::uint32_t>());
+				CacheEntry entry;
+				entry.label = reader.read_string(reader.read<std::uint32_t>());
+				entry.mtime = reader.read<std::int64_t>();
+				entry.file_size = reader.read<std::uint64_t>();
+				entry.channels = reader.read<std::int32_t>();
+				entry.width = reader.read<std::int32_t>();
+				entry.height = reader.read<std::int32_t>();
+				std::uint64_t offset = reader.read<std::uint64_t>();
+				std::uint64_t bytes = pixel_bytes(entry.channels, entry.width, entry.height);
+				if (entry.channels < 0 || entry.width < 0 || entry.height < 0 ||
+					offset > file->size() || bytes > file->size() - offset) {
+					return {};
+				}
+				entry.pixels = file->data() + offset;
+				entries[path] = entry;
+			}
+		} catch (const std::exception& e) {
+			std::cerr << "Ignoring image cache " << cache_path << ": " << e.what() << std::endl;
+			return {};
+		}
+		return entries;
+	}
+
+	// One image file on its way through the ImageFolder constructor
+	struct PendingImage {
+		int label_index;
+		std::string path;
+		std::string relative_path; // Cache key
+		std::int64_t mtime = 0;
+		std::uint64_t file_size = 0;
+		const CacheEntry* cached = nullptr; // Up to date cache entry, if any
+		PixelImagePtr image; // Null if decoding failed
+		int channels = 0, width = 0, height = 0;
+		// Freshly decoded pixels, kept until they are written to the cache
+		std::shared_ptr<unsigned char> decoded;
+
+		const unsigned char* pixels() const { return cached ? cached->pixels : decoded.get(); }
+	};
+
+	// Writes every pending image, failures included so they are not retried on every run.
+	// Goes through a temporary file and a rename, and only warns on failure: the cache is an optimisation
+	void write_cache(const std::string& cache_path, const std::vector<PendingImage>& pending)
+	{
+		std::uint64_t header_size = sizeof(cache_magic) + 2 * sizeof(std::uint32_t);
+		for (const auto& entry : pending) {
+			header_size += sizeof(std::uint32_t) + entry.relative_path.size() + sizeof(std::uint32_t) +
+				entry.relative_path.find('/') + 2 * sizeof(std::int64_t) + 3 * sizeof(std::int32_t) + sizeof(std::uint64_t);
+		}
+
+		std::string temporary = cache_path + ".tmp";
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		auto write = [&out](const void* data, std::size_t bytes) {
+			out.write(static_cast<const char*>(data), bytes);
+		};
+		write(cache_magic, sizeof(cache_magic));
+		write(&cache_version, sizeof(cache_version));
+		std::uint32_t count = static_cast<std::uint32_t>(pending.size());
+		write(&count, sizeof(count));
+
+		std::uint64_t offset = align64(header_size);
+		for (const auto& entry : pending) {
+			std::string label = entry.relative_path.substr(0, entry.relative_path.find('/'));
+			std::uint32_t path_length = static_cast<std::uint32_t>(entry.relative_path.size());
+			std::uint32_t label_length = static_cast<std::uint32_t>(label.size());
+			write(&path_length, sizeof(path_length));
+			write(entry.relative_path.data(), path_length);
+			write(&label_length, sizeof(label_length));
+			write(label.data(), label_length);
+			write(&entry.mtime, sizeof(entry.mtime));
+			write(&entry.file_size, sizeof(entry.file_size));
+			// A failed decode is stored as an empty image
+			std::int32_t shape[3] = {entry.image ? entry.channels : 0, entry.image ? entry.width : 0, entry.image ? entry.height : 0};
+			write(shape, sizeof(shape));
+			write(&offset, sizeof(offset));
+			offset = align64(offset + pixel_bytes(shape[0], shape[1], shape[2]));
+		}
+
+		const char zeros[64] = {};
+		std::uint64_t position = header_size;
+		for (const auto& entry : pending) {
+			if (!entry.image) {
+				continue;
+			}
+			write(zeros, align64(position) - position);
+			position = align64(position);
+			std::uint64_t bytes = pixel_bytes(entry.channels, entry.width, entry.height);
+			write(entry.pixels(), bytes);
+			position += bytes;
+		}
+
+		out.close();
+		if (!out || std::rename(temporary.c_str(), cache_path.c_str()) != 0) {
+			std::remove(temporary.c_str());
+			std::cerr << "Could not write image cache " << cache_path << std::endl;
+		}
+	}
+
+	std::int64_t modification_time(const fs::path& path) {
+		return static_cast<std::int64_t>(fs::last_write_time(path).time_since_epoch().count());
+	}
+
+	// <folder_root>/.imagefolder_cache when the dataset folder is writable. Otherwise (read-only
+	// mounts) a file named after a hash of the folder's absolute path under $XDG_CACHE_HOME,
+	// ~/.cache or the temp directory
+	std::string default_cache_path(const std::string& folder_root)
+	{
+		if (::access(folder_root.c_str(), W_OK) == 0) {
+			return (fs::path(folder_root) / ".imagefolder_cache").string();
+		}
+		fs::path base;
+		if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+			base = xdg;
+		} else if (const char* home = std::getenv("HOME"); home && *home) {
+			base = fs::path(home) / ".cache";
+		} else {
+			base = fs::temp_directory_path();
+		}
+		base /= "imagefolder";
+		std::error_code error;
+		fs::create_directories(base, error);
+		
+		// FNV-1a, so the name is the same from build to build
+		std::uint64_t hash = 14695981039346656037ull;
+		for (char c : fs::absolute(folder_root).lexically_normal().generic_string()) {
+			hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+		}
+		char name[17];
+		std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+		return (base / name).string();
+	}
+}
+
+
+PixelImage ImageFolder::raw_img_to_planes(const unsigned char* raw_img, int channels, int width, int height) const
 {
-	
-	std::vector<Eigen::MatrixXd> final_image(channels, Eigen::MatrixXd(height, width));
-	int col;
-	int channel;
-	int pixel_index;
-	for (channel = 0; channel < channels; channel++)
+	PixelImage image;
+	image.channels = channels;
+	image.height = height;
+	image.width = width;
+	image.pixels.resize(static_cast<size_t>(channels) * height * width);
+	size_t plane_size = static_cast<size_t>(height) * width;
+	for (int channel = 0; channel < channels; channel++)
 	{
-		for (int row = 0; row < height; row++)
+		unsigned char* plane = image.pixels.data() + channel * plane_size;
+		for (size_t pixel = 0; pixel < plane_size; pixel++)
 		{
-			for (col = 0; col < width; col++)
-			{
-				pixel_index = (row * width + col) * channels;
-				final_image[channel](row,col) = raw_img[pixel_index + channel] / 255.0;
-			}
+			plane[pixel] = raw_img[pixel * channels + channel];
 		}
 	}
-	return final_image;
+	return image;
 }
 
 
-ImageFolder::ImageFolder(std::string folder_root)
+ImageFolder::ImageFolder(std::string folder_root, int num_workers, bool use_cache, std::string cache_path)
 {
 	// // Init. member variables
 	num_classes = 0;
 	root_folder_path = folder_root;
+	if (use_cache && cache_path.empty()) {
+		cache_path = default_cache_path(folder_root);
+	}
 	
-	// Temp. variables for convenience
-	std::string abs_path;
-	std::string current_label;
-	// string ext;
-	int channels, width, height; //temp variables
-	
-	// Traverse top level directory ('./<ds>/train')
+	// Pass 1: traversal only. Directory iteration order is unspecified, so labels and
+	// files are sorted by name, which makes label indices and image order reproducible
+	std::vector<fs::path> label_dirs;
 	for (const auto& dir_or_file: fs::directory_iterator(folder_root)){
-		
-		// Reset current path(i.e. what 'cwd' would return) to base directory of train/val dataset
-		fs::current_path(folder_root);
-		
 		// Check that it is a directory, not a bs file that somehow made it in(e.g. ".DS_store", extremely problematic)
 		if (dir_or_file.is_directory())
 		{
-			
-			std::cout << "Path to dir is:  " << dir_or_file.path() << std::endl;
-			
-			// Retrieve current directory name, assuming directory name is label name, like "rose" or "1"
-			current_label = dir_or_file.path().filename().string();
-			std::cout << "Current label(adding to labels vector) is:" << current_label << std::endl;
-			
-			// Process new label
-			num_classes+=1;
-			labels.push_back(current_label); // provides index to label mapping
-			label_counts[current_label] = 0;
-			
-			// Add empty nested vector for new labels
-			// images.push_back({}); 
-			// images_data.push_back({});
-			
-			// Simpler, less wierd 
-			images.emplace_back();
-			images_data.emplace_back();
-			
-			for (const auto& img_file: fs::directory_iterator(dir_or_file.path()))
+			label_dirs.push_back(dir_or_file.path());
+		}
+	}
+	std::sort(label_dirs.begin(), label_dirs.end());
+	
+	std::vector<PendingImage> pending;
+	for (const auto& dir : label_dirs)
+	{
+		std::cout << "Path to dir is:  " << dir << std::endl;
+		
+		// Retrieve current directory name, assuming directory name is label name, like "rose" or "1"
+		std::string current_label = dir.filename().string();
+		std::cout << "Current label(adding to labels vector) is:" << current_label << std::endl;
+		
+		std::vector<fs::path> files;
+		for (const auto& img_file: fs::directory_iterator(dir))
+		{
+			// Get extension of current file, verify it's a valid image file
+			std::string ext = img_file.path().extension().string();
+			if (img_file.is_regular_file() && ((ext == ".jpg") || (ext == ".png") || (ext == ".jpeg")))
 			{
-				// std::cout << "Path to this img: " << img_file.path().string() << std::endl;
-				// Get extension of current file, verify it's a valid image file
-				std::string ext = img_file.path().extension().string();
-				if (img_file.is_regular_file() && ((ext == ".jpg") || (ext == ".png") || (ext == ".jpeg")))
-				{
-					// std::cout << "Adding the image at path: " << img_file << std::endl;
-					
-					// Read raw image from file path
-					unsigned char* curr_img_raw = stbi_load(img_file.path().string().data(), &width, &height, &channels, 0);
-					
-					if (!curr_img_raw)
-					{
-						std::cerr << "Failed to load image: " << img_file.path() << std::endl;
-						continue; // Skip this image and move on
-					}
-					
-					// Convert to Eigen Matrix
-					auto raw_vec = raw_img_to_matrix(curr_img_raw, channels, width, height);
-					ImagePtr img_ptr = std::make_shared<ImageChannels>(std::move(raw_vec));
-					
-					// Add image to last added nested vector, which corresponds to current label
-					images.back().push_back(img_ptr);
-					
-					// Add image metadata
-					ImageStruct meta;
-					meta.channels = channels;
-					meta.width = width;
-					meta.height = height;
-					meta.actual_image = img_ptr;
-					meta.file_path = img_file.path().string();
-					meta.label = current_label;
-					
-					images_data.back().push_back(meta);
-					
-					label_counts[current_label] += 1; // Increment count of images with this label
-					
-					// Free raw image buffer
-					stbi_image_free(curr_img_raw);
-				}
+				files.push_back(img_file.path());
 			}
 		}
+		std::sort(files.begin(), files.end());
+		for (const auto& file : files)
+		{
+			PendingImage entry;
+			entry.label_index = num_classes;
+			entry.path = file.string();
+			entry.relative_path = (dir.filename() / file.filename()).generic_string();
+			entry.mtime = modification_time(file);
+			entry.file_size = fs::file_size(file);
+			pending.push_back(std::move(entry));
+		}
+		
+		// Process new label
+		num_classes+=1;
+		labels.push_back(current_label); // provides index to label mapping
+		label_counts[current_label] = 0;
+		images.emplace_back();
+		images_data.emplace_back();
+	}
+	
+	// Cache entries are reused only while the source file has the same mtime and size
+	std::shared_ptr<MappedFile> cache_file;
+	std::unordered_map<std::string, CacheEntry> cache;
+	if (use_cache) {
+		cache = read_cache(cache_path, cache_file);
+	}
+	size_t reused = 0;
+	for (auto& entry : pending)
+	{
+		auto found = cache.find(entry.relative_path);
+		if (found != cache.end() && found->second.mtime == entry.mtime && found->second.file_size == entry.file_size &&
+			found->second.label == labels[entry.label_index]) {
+			entry.cached = &found->second;
+			reused++;
+		}
+	}
+	
+	// Pass 2: decode (or convert cached pixels) in parallel. Every task writes only its own slot, so no locking is needed
+	if (num_workers <= 0) {
+		num_workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	ThreadPool pool(num_workers);
+	pool.parallel_for(0, static_cast<int>(pending.size()), [&](int i) {
+		PendingImage& entry = pending[i];
+		const unsigned char* pixels = nullptr;
+		if (entry.cached) {
+			entry.channels = entry.cached->channels;
+			entry.width = entry.cached->width;
+			entry.height = entry.cached->height;
+			pixels = entry.cached->pixels;
+		} else {
+			int channels, width, height;
+			unsigned char* curr_img_raw = stbi_load(entry.path.c_str(), &width, &height, &channels, 0);
+			if (!curr_img_raw) {
+				return;
+			}
+			// Raw image buffer is freed once the cache has been written
+			entry.decoded = std::shared_ptr<unsigned char>(curr_img_raw, stbi_image_free);
+			entry.channels = channels;
+			entry.width = width;
+			entry.height = height;
+			pixels = curr_img_raw;
+		}
+		if (entry.channels > 0) {
+			// Kept as bytes, DataLoader converts to Scalar batch by batch
+			entry.image = std::make_shared<PixelImage>(raw_img_to_planes(pixels, entry.channels, entry.width, entry.height));
+		}
+	});
+	
+	if (use_cache) {
+		std::cout << "Image cache: reused " << reused << " of " << pending.size() << " decoded images" << std::endl;
+		// Rewritten whenever anything was decoded or a cached file disappeared
+		if (reused != pending.size() || reused != cache.size()) {
+			write_cache(cache_path, pending);
+		}
+	}
+	
+	// Pass 3: collect in traversal order
+	for (auto& entry : pending)
+	{
+		if (!entry.image)
+		{
+			std::cerr << "Failed to load image: " << entry.path << std::endl;
+			continue; // Skip this image and move on
+		}
+		const std::string& current_label = labels[entry.label_index];
+		images[entry.label_index].push_back(entry.image);
+		
+		// Add image metadata
+		ImageStruct meta;
+		meta.channels = entry.channels;
+		meta.width = entry.width;
+		meta.height = entry.height;
+		meta.actual_image = entry.image;
+		meta.file_path = entry.path;
+		meta.label = current_label;
+		images_data[entry.label_index].push_back(meta);
+		
+		label_counts[current_label] += 1; // Increment count of images with this label
 	}
 }
 
@@ -137,19 +376,21 @@ DataLoader::DataLoader(const ImageFolder& image_folder,
 {
 	for (int label = 0; label < static_cast<int>(image_folder.images.size()); ++label) {
 		for (const auto& img_ptr : image_folder.images[label]) {
-			// Dereference shared_ptr to get actual vector<Eigen::MatrixXd>
-			std::vector<Eigen::MatrixXd> input = *img_ptr ;  
-			data.emplace_back(input, one_hot_encode(label));
+			// Points at the folder's pixels, nothing is converted until a batch needs it
+			samples.push_back({img_ptr->pixels.data(), nullptr, img_ptr->channels, img_ptr->height, img_ptr->width, label});
+			storage.push_back(img_ptr);
 		}
 	}
+	order.resize(samples.size());
+	std::iota(order.begin(), order.end(), 0);
 
 	if (shuffle) {
 		shuffle_data();
 	}
 
-	num_batches = (data.size() + batch_size - 1) / batch_size;
+	num_batches = (samples.size() + batch_size - 1) / batch_size;
 }
-DataLoader::DataLoader(const std::vector<Eigen::MatrixXd>& input_data, 
+DataLoader::DataLoader(const std::vector<MatrixXs>& input_data, 
 					   const std::vector<int>& labels,
 					   int batch_size,
 					   int num_classes,
@@ -161,66 +402,358 @@ DataLoader::DataLoader(const std::vector<Eigen::MatrixXd>& input_data,
 		throw std::runtime_error("Input data and labels must have the same size");
 	}
 	
-	// Store the data
+	// Store the data, back to back in one buffer laid out like a batch
+	size_t total = 0;
+	for (const auto& matrix : input_data) {
+		total += matrix.size();
+	}
+	auto values = std::make_shared<std::vector<Scalar>>(total);
+	Scalar* next = values->data();
 	for (size_t i = 0; i < input_data.size(); ++i) {
-		std::vector<Eigen::MatrixXd> input;
-		input.push_back(input_data[i]);
-		data.emplace_back(input, one_hot_encode(labels[i]));
+		const MatrixXs& matrix = input_data[i];
+		Tensor::MatrixMap(next, matrix.rows(), matrix.cols()) = matrix;
+		samples.push_back({nullptr, next, 1, static_cast<int>(matrix.rows()), static_cast<int>(matrix.cols()), labels[i]});
+		next += matrix.size();
 	}
+	storage.push_back(values);
+	order.resize(samples.size());
+	std::iota(order.begin(), order.end(), 0);
 	
 	if (shuffle) {
 		shuffle_data();
 	}
 	
-	num_batches = (data.size() + batch_size - 1) / batch_size;
+	num_batches = (samples.size() + batch_size - 1) / batch_size;
 }
 
-std::vector<Eigen::MatrixXd> DataLoader::one_hot_encode(int label) {
-	std::vector<Eigen::MatrixXd> encoded;
-	Eigen::MatrixXd label_matrix = Eigen::MatrixXd::Zero(num_classes, 1);
-	label_matrix(label, 0) = 1.0;
-	encoded.push_back(label_matrix);
-	return encoded;
+DataLoader::DataLoader(const IdxFile& images,
+					   const IdxFile& labels,
+					   int batch_size,
+					   int num_classes,
+					   bool shuffle,
+					   int max_samples)
+	: batch_size(batch_size), num_classes(num_classes), shuffle(shuffle), current_batch(0) {
+	
+	const std::vector<int>& dims = images.dims();
+	if (dims.size() != 3 && dims.size() != 4) {
+		throw std::runtime_error("IDX images must be (count, height, width) or (count, channels, height, width)");
+	}
+	if (labels.dims().size() != 1 || labels.count() != images.count()) {
+		throw std::runtime_error("IDX labels must be one byte per image");
+	}
+	int channels = dims.size() == 4 ? dims[1] : 1;
+	int height = dims[dims.size() - 2];
+	int width = dims[dims.size() - 1];
+	int count = max_samples > 0 ? std::min(max_samples, images.count()) : images.count();
+	
+	for (int i = 0; i < count; ++i) {
+		int label = labels.item(i)[0];
+		if (label >= num_classes) {
+			throw std::runtime_error("IDX label " + std::to_string(label) + " is out of range for " + std::to_string(num_classes) + " classes");
+		}
+		samples.push_back({images.item(i), nullptr, channels, height, width, label});
+	}
+	storage.push_back(images.mapping());
+	order.resize(samples.size());
+	std::iota(order.begin(), order.end(), 0);
+	
+	if (shuffle) {
+		shuffle_data();
+	}
+	
+	num_batches = (samples.size() + batch_size - 1) / batch_size;
 }
 
-void DataLoader::shuffle_data() {
+DataLoader::DataLoader(const DataLoader& other)
+	: batch_size(other.batch_size),
+	  num_classes(other.num_classes),
+	  samples(other.samples),
+	  storage(other.storage),
+	  order(other.order),
+	  pixel_scale(other.pixel_scale),
+	  pixel_shift(other.pixel_shift),
+	  shuffle(other.shuffle),
+	  current_batch(other.current_batch),
+	  num_batches(other.num_batches)
+{
+	set_prefetch(other.prefetch_workers, other.prefetch_depth);
+}
+
+DataLoader& DataLoader::operator=(const DataLoader& other) {
+	if (this != &other) {
+		stop_prefetch();
+		batch_size = other.batch_size;
+		num_classes = other.num_classes;
+		samples = other.samples;
+		storage = other.storage;
+		order = other.order;
+		pixel_scale = other.pixel_scale;
+		pixel_shift = other.pixel_shift;
+		shuffle = other.shuffle;
+		current_batch = other.current_batch;
+		num_batches = other.num_batches;
+		set_prefetch(other.prefetch_workers, other.prefetch_depth);
+	}
+	return *this;
+}
+
+DataLoader::~DataLoader() {
+	stop_prefetch();
+}
+
+// Batch i goes to slot i % depth. Producers claim batch numbers in order but only while
+// they are less than depth ahead of the consumer, so a claimed batch's slot is always free.
+// Everything here and current_batch are guarded by mutex while prefetching
+struct DataLoader::Prefetcher {
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable can_produce;
+	std::condition_variable batch_done;
+	std::vector<std::pair<Tensor, Tensor>> slots;
+	std::vector<int> slot_batch; // Batch number held by each slot, -1 when empty
+	std::vector<std::exception_ptr> slot_error;
+	int next_batch = 0; // Next batch number to claim
+	int in_flight = 0; // Batches being assembled right now
+	long generation = 0; // Bumped whenever the order changes, so stale batches get dropped
+	bool paused = false;
+	bool stopping = false;
+};
+
+void DataLoader::set_prefetch(int num_workers, int depth) {
+	stop_prefetch();
+	prefetch_workers = std::max(0, num_workers);
+	prefetch_depth = std::max(1, depth);
+	if (prefetch_workers == 0) {
+		return;
+	}
+	prefetcher = std::make_unique<Prefetcher>();
+	prefetcher->slots.resize(prefetch_depth);
+	prefetcher->slot_batch.assign(prefetch_depth, -1);
+	prefetcher->slot_error.resize(prefetch_depth);
+	prefetcher->next_batch = current_batch;
+	for (int i = 0; i < prefetch_workers; i++) {
+		prefetcher->workers.emplace_back(&DataLoader::producer_loop, this);
+	}
+}
+
+void DataLoader::stop_prefetch() {
+	if (!prefetcher) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(prefetcher->mutex);
+		prefetcher->stopping = true;
+	}
+	prefetcher->can_produce.notify_all();
+	for (auto& worker : prefetcher->workers) {
+		worker.join();
+	}
+	prefetcher.reset();
+}
+
+void DataLoader::producer_loop() {
+	Prefetcher& p = *prefetcher;
+	std::unique_lock<std::mutex> lock(p.mutex);
+	while (true) {
+		p.can_produce.wait(lock, [&] {
+			return p.stopping ||
+				(!p.paused && p.next_batch < num_batches && p.next_batch < current_batch + prefetch_depth);
+		});
+		if (p.stopping) {
+			return;
+		}
+		int index = p.next_batch++;
+		long generation = p.generation;
+		p.in_flight++;
+		lock.unlock();
+
+		std::pair<Tensor, Tensor> batch;
+		std::exception_ptr error;
+		try {
+			batch = assemble_batch(index);
+		} catch (...) {
+			error = std::current_exception();
+		}
+
+		lock.lock();
+		p.in_flight--;
+		if (generation == p.generation) {
+			int slot = index % prefetch_depth;
+			p.slots[slot] = std::move(batch);
+			p.slot_error[slot] = error;
+			p.slot_batch[slot] = index;
+		}
+		p.batch_done.notify_all();
+	}
+}
+
+void DataLoader::pause_prefetch(std::unique_lock<std::mutex>& lock) {
+	Prefetcher& p = *prefetcher;
+	p.generation++;
+	p.paused = true;
+	// Batches being assembled still read order, let them finish (they are dropped)
+	p.batch_done.wait(lock, [&] { return p.in_flight == 0; });
+	std::fill(p.slot_batch.begin(), p.slot_batch.end(), -1);
+	for (auto& slot : p.slots) {
+		slot = {};
+	}
+}
+
+void DataLoader::resume_prefetch() {
+	prefetcher->paused = false;
+	prefetcher->next_batch = current_batch;
+	prefetcher->can_produce.notify_all();
+}
+
+void DataLoader::shuffle_order() {
 	std::random_device rd;
 	std::mt19937 gen(rd());
-	std::shuffle(data.begin(), data.end(), gen);
+	std::shuffle(order.begin(), order.end(), gen);
 }
 
-std::pair<std::vector<std::vector<Eigen::MatrixXd>>, std::vector<std::vector<Eigen::MatrixXd>>> 
-DataLoader::get_next_batch() {
-    if (current_batch >= num_batches) {
-        throw std::runtime_error("No more batches available");
-    }
+void DataLoader::shuffle_data() {
+	if (!prefetcher) {
+		shuffle_order();
+		return;
+	}
+	std::unique_lock<std::mutex> lock(prefetcher->mutex);
+	pause_prefetch(lock);
+	shuffle_order();
+	resume_prefetch();
+}
 
-	std::vector<std::vector<Eigen::MatrixXd>> batch_inputs;
-	std::vector<std::vector<Eigen::MatrixXd>> batch_labels;
+void DataLoader::set_normalization(const std::vector<Scalar>& mean, const std::vector<Scalar>& std) {
+	if (mean.empty() || mean.size() != std.size()) {
+		throw std::invalid_argument("Normalization needs one mean and one std per channel");
+	}
+	std::vector<Scalar> scale(mean.size()), shift(mean.size());
+	for (size_t c = 0; c < mean.size(); c++) {
+		if (!(std[c] > 0)) {
+			throw std::invalid_argument("Normalization std must be positive");
+		}
+		scale[c] = 1 / (255 * std[c]);
+		shift[c] = -mean[c] / std[c];
+	}
+	if (!prefetcher) {
+		pixel_scale = scale;
+		pixel_shift = shift;
+		return;
+	}
+	// Batches already assembled used the old values, so they are redone
+	std::unique_lock<std::mutex> lock(prefetcher->mutex);
+	pause_prefetch(lock);
+	pixel_scale = scale;
+	pixel_shift = shift;
+	resume_prefetch();
+}
 
-	int start_idx = current_batch * batch_size;
-	int end_idx = std::min(start_idx + batch_size, static_cast<int>(data.size()));
+std::pair<Tensor, Tensor> DataLoader::assemble_batch(int index) const {
+	int start_idx = index * batch_size;
+	int end_idx = std::min(start_idx + batch_size, static_cast<int>(samples.size()));
 
-	for (int i = start_idx; i < end_idx; ++i) {
-		batch_inputs.push_back(data[i].first);
-		batch_labels.push_back(data[i].second);
+	const Sample& first = samples[order[start_idx]];
+	Tensor batch_inputs(end_idx - start_idx, first.channels, first.height, first.width);
+	Tensor batch_labels(end_idx - start_idx, 1, num_classes, 1);
+	if (first.pixels && pixel_scale.size() != 1 && static_cast<int>(pixel_scale.size()) != first.channels) {
+		throw std::runtime_error("Normalization has " + std::to_string(pixel_scale.size()) +
+			" channels but the images have " + std::to_string(first.channels));
 	}
+	long plane_size = static_cast<long>(first.height) * first.width;
 
-	current_batch++;
+	// A single gather straight into the batch. Raw values that sit back to back in storage
+	// (always, without shuffling) go over in one memcpy per run
+	for (int i = start_idx; i < end_idx; ) {
+		const Sample& sample = samples[order[i]];
+		Scalar* out = batch_inputs.data() + static_cast<long>(i - start_idx) * batch_inputs.sample_size();
+		if (sample.channels != first.channels || sample.height != first.height || sample.width != first.width) {
+			throw std::runtime_error("All images in a batch must have the same dimensions");
+		}
+		batch_labels.channel(i - start_idx, 0)(sample.label, 0) = 1;
+		if (sample.pixels) {
+			// One fused, vectorizable pass per plane: widen, scale and shift
+			for (int c = 0; c < sample.channels; ++c) {
+				size_t k = pixel_scale.size() == 1 ? 0 : c;
+				Eigen::Map<const Eigen::Array<unsigned char, Eigen::Dynamic, 1>> pixels(sample.pixels + c * plane_size, plane_size);
+				Eigen::Map<ArrayXs>(out + c * plane_size, plane_size) = pixels.cast<Scalar>() * pixel_scale[k] + pixel_shift[k];
+			}
+			++i;
+			continue;
+		}
+		const Scalar* run_end = sample.values + sample.size();
+		int j = i + 1;
+		for (; j < end_idx; ++j) {
+			const Sample& next = samples[order[j]];
+			if (next.values != run_end || next.channels != first.channels || next.height != first.height || next.width != first.width) {
+				break;
+			}
+			batch_labels.channel(j - start_idx, 0)(next.label, 0) = 1;
+			run_end += next.size();
+		}
+		std::memcpy(out, sample.values, (run_end - sample.values) * sizeof(Scalar));
+		i = j;
+	}
 	return {batch_inputs, batch_labels};
 }
 
+std::pair<Tensor, Tensor> DataLoader::get_next_batch() {
+	if (!prefetcher) {
+		if (current_batch >= num_batches) {
+			throw std::runtime_error("No more batches available");
+		}
+		return assemble_batch(current_batch++);
+	}
+
+	Prefetcher& p = *prefetcher;
+	std::unique_lock<std::mutex> lock(p.mutex);
+	if (current_batch >= num_batches) {
+		throw std::runtime_error("No more batches available");
+	}
+	int slot = current_batch % prefetch_depth;
+	p.batch_done.wait(lock, [&] { return p.slot_batch[slot] == current_batch; });
+	std::pair<Tensor, Tensor> batch = std::move(p.slots[slot]);
+	std::exception_ptr error = p.slot_error[slot];
+	p.slot_batch[slot] = -1;
+	p.slot_error[slot] = nullptr;
+	current_batch++;
+	p.can_produce.notify_all();
+	if (error) {
+		std::rethrow_exception(error);
+	}
+	return batch;
+}
+
+std::pair<Tensor, Tensor> DataLoader::get_batch(int index) const {
+	if (index < 0 || index >= num_batches) {
+		throw std::out_of_range("Batch " + std::to_string(index) + " of " + std::to_string(num_batches));
+	}
+	return assemble_batch(index);
+}
+
 bool DataLoader::has_next_batch() const {
+	if (prefetcher) {
+		std::lock_guard<std::mutex> lock(prefetcher->mutex);
+		return current_batch < num_batches;
+	}
 	return current_batch < num_batches;
 }
 
 void DataLoader::reset() {
+	if (!prefetcher) {
+		current_batch = 0;
+		if (shuffle) {
+			shuffle_order();
+		}
+		return;
+	}
+	std::unique_lock<std::mutex> lock(prefetcher->mutex);
+	pause_prefetch(lock);
 	current_batch = 0;
 	if (shuffle) {
-		shuffle_data();
+		shuffle_order();
 	}
+	resume_prefetch();
 }
 
 int DataLoader::get_num_batches() const {
 	return num_batches;
-}
\ No newline at end of file
+}
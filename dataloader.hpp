@@ -9,15 +9,34 @@
 #include <sstream>
 #include <string>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "tensor.hpp"
+#include "idx.hpp"
 using namespace std;
 
+// Decoded 8-bit image, one plane per channel (CHW), each plane row-major.
+// A quarter (float) or an eighth (double) of the size of the same image as Scalars;
+// DataLoader converts and normalizes when it assembles a batch
+struct PixelImage
+{
+	int channels;
+	int height;
+	int width;
+	std::vector<unsigned char> pixels;
+
+	const unsigned char* plane(int channel) const { return pixels.data() + static_cast<size_t>(channel) * height * width; }
+};
+using PixelImagePtr = std::shared_ptr<const PixelImage>;
+
 typedef struct ImageStruct
 {
 	int channels;
 	int height;
 	int width;
 	string file_path;
-	std::shared_ptr<std::vector<Eigen::MatrixXd>> actual_image; 
+	PixelImagePtr actual_image; 
 	string label;
 } ImageStruct;
 
@@ -26,9 +45,16 @@ class ImageFolder
 	public:
 		// Initialise image folder with all the images from the nested directory structure
 		// Only relevant method of class
-		ImageFolder(string folder_root);
+		// Labels and the images under each are ordered by name, so the result is the same on every run.
+		// Files are decoded on num_workers threads (0 = one per hardware thread).
+		// With use_cache, decoded pixels are kept in a binary cache file (cache_path, by default
+		// <folder_root>/.imagefolder_cache, or a per-user cache directory when folder_root is not
+		// writable) along with each source file's mtime and size. Later runs map the cache, copy the
+		// pixels out into planes and only decode files that are new or changed since
+		ImageFolder(string folder_root, int num_workers = 0, bool use_cache = true, string cache_path = "");
 		unordered_map<string, int> get_label_counts();
-		std::vector<Eigen::MatrixXd> raw_img_to_matrix(unsigned char* img, int channels, int width, int height);
+		// Splits stb_image's interleaved pixels into planes. Safe to call from several threads at once
+		PixelImage raw_img_to_planes(const unsigned char* img, int channels, int width, int height) const;
 		~ImageFolder(); // Destructor to avoid memory leaks
 		string root_folder_path;
 		vector<string> labels;
@@ -36,9 +62,8 @@ class ImageFolder
 		
 		// How images are stored:
 		// 4 dimensions: 1 - which label, 2 - which image in label,
-		// 3(shared ptr) - which channel in image, 
-		// 4 - actual matrix containing pixel values for that image
-		vector<vector<std::shared_ptr<std::vector<Eigen::MatrixXd>>>> images; // shared ptr makes our life way easier
+		// 3(shared ptr) - the image's raw 8-bit pixels, see PixelImage
+		vector<vector<PixelImagePtr>> images; // shared ptr makes our life way easier
 		
 		// Store image metadata by image
 		// Not separated by channels obviously, so dimensions only are 1. Label, 2. Image
@@ -55,22 +80,47 @@ public:
 
 	// Construct from raw matrices + integer labels
 	// Not preferred
-	DataLoader(const std::vector<Eigen::MatrixXd>& input_data,
+	DataLoader(const std::vector<MatrixXs>& input_data,
 			   const std::vector<int>& labels,
 			   int batch_size,
 			   int num_classes,
 			   bool shuffle = true);
 
+	// Construct from IDX files (e.g. MNIST): 8-bit images shaped (count, height, width) or
+	// (count, channels, height, width), and one label byte per image. Samples point straight
+	// into the mapped images, nothing is copied. max_samples > 0 keeps only the first ones
+	DataLoader(const IdxFile& images,
+			   const IdxFile& labels,
+			   int batch_size,
+			   int num_classes,
+			   bool shuffle = true,
+			   int max_samples = 0);
+
+	// Copies share nothing with the original, a prefetching loader's copy starts its own workers
+	DataLoader(const DataLoader& other);
+	DataLoader& operator=(const DataLoader& other);
+	~DataLoader();
+
+	// Asynchronous mode: num_workers threads assemble batches up to depth ahead of get_next_batch,
+	// so loading overlaps with training. Batches come out in the same order and with the same
+	// contents as without it, and reset()/shuffle_data() still take effect at the next batch.
+	// num_workers = 0 switches back to assembling on the calling thread
+	void set_prefetch(int num_workers, int depth = 2);
+
+	// Per-channel normalization of ImageFolder pixels, on the [0, 1] scale:
+	// value = (pixel / 255 - mean[c]) / std[c]. One entry applies to every channel.
+	// The default (mean 0, std 1) gives plain pixel / 255. Raw-matrix data is never rescaled
+	void set_normalization(const std::vector<Scalar>& mean, const std::vector<Scalar>& std);
+
 	// Get next batch:
-	//  - first:  batch_inputs  = vector< sample >,
-	//                    sample = vector< channel_matrices >
-	//  - second: batch_labels  = vector< sample >,
-	//                    sample = vector< one_hot_matrix >
-	std::pair<
-		std::vector<std::vector<Eigen::MatrixXd>>,   // batch_inputs
-		std::vector<std::vector<Eigen::MatrixXd>>    // batch_labels
-	>
-	get_next_batch();
+	//  - first:  batch_inputs  = (batch, channels, height, width)
+	//  - second: batch_labels  = (batch, 1, num_classes, 1), one-hot
+	// All images in a batch must share the same dimensions
+	std::pair<Tensor, Tensor> get_next_batch();
+	// Batch number index of the current epoch order, the same one get_next_batch returns for it,
+	// without moving the cursor. Safe to call from several threads at once, but not alongside
+	// reset() or shuffle_data(). Always assembled on the calling thread, prefetching or not
+	std::pair<Tensor, Tensor> get_batch(int index) const;
 
 	bool has_next_batch() const;
 	void reset();
@@ -80,18 +130,44 @@ public:
 	void shuffle_data();
 
 private:
-	// data[i].first  = vector<Eigen::MatrixXd>  → channels of image i
-	// data[i].second = vector<Eigen::MatrixXd>  → one‑hot label for image i
-	std::vector<
-		std::pair<
-			std::vector<Eigen::MatrixXd>,
-			std::vector<Eigen::MatrixXd>
-		>
-	> data;
+	// Where one sample lives. Samples only point into storage: the ImageFolder's pixels, or one
+	// buffer filled when constructing from raw matrices, or an IDX mapping. Shuffling, copying the loader and
+	// assembling a batch never move anything but what ends up in the batch
+	struct Sample {
+		const unsigned char* pixels; // CHW bytes, normalized during assembly, or
+		const Scalar* values;        // CHW values, copied as they are
+		int channels;
+		int height;
+		int width;
+		int label;
+
+		long size() const { return static_cast<long>(channels) * height * width; }
+	};
+	std::vector<Sample> samples;
+	// Owners of whatever samples point into, shared by copies of the loader
+	std::vector<std::shared_ptr<const void>> storage;
+	// Sample index at each position of the epoch. Shuffling permutes this, never samples
+	std::vector<std::uint32_t> order;
+	// value = pixel * pixel_scale[c] + pixel_shift[c], folded from the mean/std of set_normalization
+	std::vector<Scalar> pixel_scale{Scalar(1) / 255};
+	std::vector<Scalar> pixel_shift{0};
 
 	bool shuffle;
 	int current_batch;
 	int num_batches;
 
-	std::vector<Eigen::MatrixXd> one_hot_encode(int label);
+	// Producer threads and their bounded ring of finished batches, see dataloader.cpp
+	struct Prefetcher;
+	std::unique_ptr<Prefetcher> prefetcher;
+	int prefetch_workers = 0;
+	int prefetch_depth = 2;
+
+	// Builds batch number index of the current order. Only reads samples and order, so producers can run it concurrently
+	std::pair<Tensor, Tensor> assemble_batch(int index) const;
+	void producer_loop();
+	// Stops the producers from reading order and normalization until resume_prefetch(); caller holds the prefetcher lock
+	void pause_prefetch(std::unique_lock<std::mutex>& lock);
+	void resume_prefetch();
+	void stop_prefetch();
+	void shuffle_order();
 };
\ No newline at end of file
@@ -4,15 +4,17 @@
 Dense::Dense(int input_size, int output_size) 
     : gen(rd()) {
     // Initialize weights with random values
-    weights = Eigen::MatrixXd::Zero(output_size, input_size);
-    bias = Eigen::MatrixXd::Zero(output_size, 1);
+    weights = Tensor(1, 1, output_size, input_size);
+    bias = Tensor(1, 1, output_size, 1);
+    weights_gradient = Tensor(weights.shape());
+    bias_gradient = Tensor(bias.shape());
     
-    std::normal_distribution<double> dist(0.0, 1.0);
+    std::normal_distribution<Scalar> dist(0.0, 1.0);
     for(int i = 0; i < output_size; i++) {
         for(int j = 0; j < input_size; j++) {
-            weights(i, j) = dist(gen);
+            weights(0, 0, i, j) = dist(gen);
         }
-        bias(i, 0) = dist(gen);
+        bias(0, 0, i, 0) = dist(gen);
     }
 
     // double stddev = std::sqrt(2.0 / input_size);
@@ -24,21 +26,36 @@ Dense::Dense(int input_size, int output_size)
     // }
 }
 
-std::vector<Eigen::MatrixXd> Dense::forward(const std::vector<Eigen::MatrixXd>& input) {
-    this->input = input;
-    std::vector<Eigen::MatrixXd> output(1);
-    output[0] = weights * input[0] + bias;
+std::shared_ptr<Layer> Dense::clone() const {
+    auto copy = std::make_shared<Dense>(weights.width(), weights.height());
+    copy->weights = weights;
+    copy->bias = bias;
+    return copy;
+}
+
+Tensor Dense::forward(const Tensor& input) {
+    if (training) {
+        this->input = input;
+    }
+    // Each sample's features are contiguous, so the batch is an (input_size x batch) column-major matrix
+    auto w = weights.channel(0, 0);
+    Eigen::Map<const MatrixXs> x(input.data(), w.cols(), input.batch());
+    Tensor output = make_output(output_shape(input.shape()));
+    Eigen::Map<MatrixXs> y(output.data(), w.rows(), input.batch());
+    y.noalias() = w * x;
+    y.colwise() += bias.flat();
     return output;
 }
 
-std::vector<Eigen::MatrixXd> Dense::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    Eigen::MatrixXd weights_gradient = output_gradient[0] * input[0].transpose();
-    Eigen::MatrixXd input_gradient = weights.transpose() * output_gradient[0];
-    
-    weights -= learning_rate * weights_gradient;
-    bias -= learning_rate * output_gradient[0];
-    
-    std::vector<Eigen::MatrixXd> result(1);
-    result[0] = input_gradient;
-    return result;
+Tensor Dense::backward(const Tensor& output_gradient) {
+    auto w = weights.channel(0, 0);
+    Eigen::Map<const MatrixXs> x(input.data(), w.cols(), input.batch());
+    Eigen::Map<const MatrixXs> grad(output_gradient.data(), w.rows(), output_gradient.batch());
+
+    weights_gradient.channel(0, 0).noalias() += grad * x.transpose();
+    bias_gradient.flat() += grad.rowwise().sum();
+    Tensor input_gradient = make_input_gradient(input.shape());
+    Eigen::Map<MatrixXs> dx(input_gradient.data(), w.cols(), input.batch());
+    dx.noalias() = w.transpose() * grad;
+    return input_gradient;
 } 
\ No newline at end of file
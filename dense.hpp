@@ -5,12 +5,22 @@
 class Dense : public Layer {
 public:
     Dense(int input_size, int output_size);
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    // Input is (batch, 1, input_size, 1), output is (batch, 1, output_size, 1)
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "Dense"; }
+    Tensor::Shape output_shape(const Tensor::Shape& input_shape) const override {
+        return {input_shape[0], 1, weights.height(), 1};
+    }
+    std::vector<Tensor*> parameters() override { return {&weights, &bias}; }
+    std::vector<Tensor*> gradients() override { return {&weights_gradient, &bias_gradient}; }
+    std::shared_ptr<Layer> clone() const override;
 
 private:
-    Eigen::MatrixXd weights;
-    Eigen::MatrixXd bias;
+    Tensor weights;  // (1, 1, output_size, input_size)
+    Tensor bias;     // (1, 1, output_size, 1)
+    Tensor weights_gradient;  // Same shapes as weights and bias, accumulated by backward
+    Tensor bias_gradient;
     std::random_device rd;
     std::mt19937 gen;
 };
\ No newline at end of file
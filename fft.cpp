@@ -0,0 +1,160 @@
+#include "fft.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+    // Plain complex product. std::complex's operator* goes through a NaN/inf-checking
+    // library call unless built with -ffast-math, which dominates the butterflies
+    inline FFT::Complex multiply(const FFT::Complex& a, const FFT::Complex& b) {
+        return FFT::Complex(a.real() * b.real() - a.imag() * b.imag(),
+                            a.real() * b.imag() + a.imag() * b.real());
+    }
+
+    // thread_scratch tag for the full-length row both directions work in
+    struct RowScratch {};
+}
+
+namespace FFT {
+    int next_power_of_two(int n) {
+        int size = 1;
+        while (size < n) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    Plan1D::Plan1D(int n) : n(n), bit_reversed(n), twiddles(n / 2) {
+        if (n < 1 || (n & (n - 1)) != 0) {
+            throw std::invalid_argument("FFT size must be a power of two, got " + std::to_string(n));
+        }
+        int bits = 0;
+        while ((1 << bits) < n) {
+            ++bits;
+        }
+        for (int i = 0; i < n; ++i) {
+            int reversed = 0;
+            for (int b = 0; b < bits; ++b) {
+                reversed |= ((i >> b) & 1) << (bits - 1 - b);
+            }
+            bit_reversed[i] = reversed;
+        }
+        // Computed in double so float builds get correctly rounded twiddles
+        for (int k = 0; k < n / 2; ++k) {
+            double angle = -2.0 * M_PI * k / n;
+            twiddles[k] = Complex(Scalar(std::cos(angle)), Scalar(std::sin(angle)));
+        }
+    }
+
+    void Plan1D::transform(Complex* data, bool inverse) const {
+        for (int i = 0; i < n; ++i) {
+            if (i < bit_reversed[i]) {
+                std::swap(data[i], data[bit_reversed[i]]);
+            }
+        }
+        for (int length = 2; length <= n; length *= 2) {
+            int half = length / 2;
+            int twiddle_step = n / length;
+            for (int start = 0; start < n; start += length) {
+                for (int k = 0; k < half; ++k) {
+                    Complex w = inverse ? std::conj(twiddles[k * twiddle_step]) : twiddles[k * twiddle_step];
+                    Complex odd = multiply(w, data[start + k + half]);
+                    data[start + k + half] = data[start + k] - odd;
+                    data[start + k] += odd;
+                }
+            }
+        }
+    }
+
+    void Plan1D::transform_columns(Complex* data, long row_length, bool inverse) const {
+        for (int i = 0; i < n; ++i) {
+            if (i < bit_reversed[i]) {
+                std::swap_ranges(data + i * row_length, data + (i + 1) * row_length, data + bit_reversed[i] * row_length);
+            }
+        }
+        for (int length = 2; length <= n; length *= 2) {
+            int half = length / 2;
+            int twiddle_step = n / length;
+            for (int start = 0; start < n; start += length) {
+                for (int k = 0; k < half; ++k) {
+                    Complex w = inverse ? std::conj(twiddles[k * twiddle_step]) : twiddles[k * twiddle_step];
+                    Complex* even_row = data + (start + k) * row_length;
+                    Complex* odd_row = even_row + half * row_length;
+                    for (long t = 0; t < row_length; ++t) {
+                        Complex odd = multiply(w, odd_row[t]);
+                        odd_row[t] = even_row[t] - odd;
+                        even_row[t] += odd;
+                    }
+                }
+            }
+        }
+    }
+
+    Plan2D::Plan2D(int rows, int cols) : row_plan(cols), col_plan(rows) {}
+
+    void Plan2D::forward(const Scalar* plane, int height, int width, int offset, int step, Complex* spectrum) const {
+        const int half = spectrum_cols();
+        std::fill(spectrum, spectrum + spectrum_size(), Complex(0));
+
+        // Rows: only the ones the plane lands on are non-zero. Two real rows go through one
+        // complex transform as its real and imaginary parts, then get separated by symmetry
+        Complex* row = thread_scratch<Complex, RowScratch>(cols());
+        for (int y = 0; y < height; y += 2) {
+            bool pair = y + 1 < height;
+            std::fill(row, row + cols(), Complex(0));
+            for (int x = 0; x < width; ++x) {
+                Scalar second = pair ? plane[(long)(y + 1) * width + x] : Scalar(0);
+                row[offset + x * step] = Complex(plane[(long)y * width + x], second);
+            }
+            row_plan.transform(row, false);
+
+            Complex* first_row = spectrum + (long)(offset + y * step) * half;
+            Complex* second_row = pair ? spectrum + (long)(offset + (y + 1) * step) * half : nullptr;
+            for (int k = 0; k < half; ++k) {
+                Complex z = row[k];
+                Complex mirrored = std::conj(row[(cols() - k) % cols()]);
+                first_row[k] = (z + mirrored) * Scalar(0.5);
+                if (pair) {
+                    Complex difference = z - mirrored;  // divided by 2i below
+                    second_row[k] = Complex(difference.imag(), -difference.real()) * Scalar(0.5);
+                }
+            }
+        }
+
+        col_plan.transform_columns(spectrum, half, false);
+    }
+
+    void Plan2D::inverse(Complex* spectrum, Scalar* plane, int height, int width, int offset, int step) const {
+        const int half = spectrum_cols();
+        const Scalar scale = Scalar(1) / (Scalar(rows()) * cols());
+
+        col_plan.transform_columns(spectrum, half, true);
+
+        // Rows: only the ones read back, two at a time as the real and imaginary parts of one
+        // complex row, each rebuilt to full length from conjugate symmetry
+        Complex* row = thread_scratch<Complex, RowScratch>(cols());
+        for (int y = 0; y < height; y += 2) {
+            bool pair = y + 1 < height;
+            const Complex* first_row = spectrum + (long)(offset + y * step) * half;
+            const Complex* second_row = pair ? spectrum + (long)(offset + (y + 1) * step) * half : nullptr;
+            for (int k = 0; k < cols(); ++k) {
+                Complex a = k < half ? first_row[k] : std::conj(first_row[cols() - k]);
+                Complex b = Complex(0);
+                if (pair) {
+                    b = k < half ? second_row[k] : std::conj(second_row[cols() - k]);
+                }
+                row[k] = a + Complex(-b.imag(), b.real());  // a + i b
+            }
+            row_plan.transform(row, true);
+            for (int x = 0; x < width; ++x) {
+                plane[(long)y * width + x] = row[offset + x * step].real() * scale;
+                if (pair) {
+                    plane[(long)(y + 1) * width + x] = row[offset + x * step].imag() * scale;
+                }
+            }
+        }
+    }
+}
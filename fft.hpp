@@ -0,0 +1,55 @@
+#pragma once
+#include "scalar.hpp"
+#include <complex>
+#include <vector>
+
+/**
+ * @brief Self-contained radix-2 FFT for real 2D planes
+ *
+ * Plan2D transforms real rows x cols planes (both powers of two) into their
+ * half spectrum: rows x (cols / 2 + 1) complex values, the rest follows from
+ * conjugate symmetry. Used by the FFT convolution path, where a pointwise
+ * product of spectra replaces the sliding-window sum.
+ */
+namespace FFT {
+    using Complex = std::complex<Scalar>;
+
+    int next_power_of_two(int n);
+
+    // In-place iterative Cooley-Tukey transform of n = 2^k complex values
+    class Plan1D {
+    public:
+        explicit Plan1D(int n);
+        int size() const { return n; }
+        // Unscaled in both directions
+        void transform(Complex* data, bool inverse) const;
+        // Transforms along the first axis of n rows of row_length values each, i.e. every
+        // column at once, so the butterflies stream through whole rows
+        void transform_columns(Complex* data, long row_length, bool inverse) const;
+
+    private:
+        int n;
+        std::vector<int> bit_reversed;
+        std::vector<Complex> twiddles;  // exp(-2 pi i k / n) for k < n / 2
+    };
+
+    class Plan2D {
+    public:
+        Plan2D(int rows, int cols);
+        int rows() const { return col_plan.size(); }
+        int cols() const { return row_plan.size(); }
+        int spectrum_cols() const { return cols() / 2 + 1; }
+        long spectrum_size() const { return (long)rows() * spectrum_cols(); }
+
+        // Half spectrum of the zero plane with plane(y, x) of a height x width, row-major
+        // plane placed at (offset + y * step, offset + x * step)
+        void forward(const Scalar* plane, int height, int width, int offset, int step, Complex* spectrum) const;
+        // Inverse of forward, normalised, gathering result(offset + y * step, offset + x * step)
+        // into a height x width plane. Overwrites spectrum
+        void inverse(Complex* spectrum, Scalar* plane, int height, int width, int offset, int step) const;
+
+    private:
+        Plan1D row_plan;  // along a row, cols() long
+        Plan1D col_plan;  // along a column, rows() long
+    };
+}
@@ -0,0 +1,154 @@
+#include "fused_conv.hpp"
+#include "thread_pool.hpp"
+#include <limits>
+#include <stdexcept>
+
+namespace {
+    // thread_scratch tag for the convolution rows under one band of pooling windows
+    struct BandRows {};
+}
+
+FusedConvReLUPool::FusedConvReLUPool(std::shared_ptr<Convolutional> conv, int pool_size, int pool_stride)
+    : conv(std::move(conv)), pool_size(pool_size), pool_stride(pool_stride == -1 ? pool_size : pool_stride) {
+    if (pool_size * pool_size >= no_gradient) {
+        throw std::invalid_argument("Pooling window too large for a one-byte argmax");
+    }
+    pooled_height = (this->conv->output_height - pool_size) / this->pool_stride + 1;
+    pooled_width = (this->conv->output_width - pool_size) / this->pool_stride + 1;
+}
+
+std::shared_ptr<Layer> FusedConvReLUPool::clone() const {
+    return std::make_shared<FusedConvReLUPool>(std::static_pointer_cast<Convolutional>(conv->clone()), pool_size, pool_stride);
+}
+
+void FusedConvReLUPool::set_training(bool training) {
+    Layer::set_training(training);
+    conv->set_training(training);
+    if (!training) {
+        argmax.clear();
+        argmax.shrink_to_fit();
+    }
+}
+
+void FusedConvReLUPool::bind_buffers(const Tensor& output_buffer, const Tensor& input_gradient_buffer) {
+    Layer::bind_buffers(output_buffer, input_gradient_buffer);
+    conv->bind_buffers(conv_scratch, input_gradient_buffer);
+}
+
+void FusedConvReLUPool::reserve_conv_scratch(int batch) {
+    long size = (long)batch * conv->depth * conv->output_height * conv->output_width;
+    if (conv_scratch.size() < size) {
+        conv_scratch = Tensor(batch, conv->depth, conv->output_height, conv->output_width);
+        conv->bind_buffers(conv_scratch, input_gradient_buffer);
+    }
+}
+
+void FusedConvReLUPool::pool_row(const Scalar* conv_rows, const Scalar* bias, Scalar* out_row, std::uint8_t* argmax_row) const {
+    const int conv_width = conv->output_width;
+    for (int pj = 0; pj < pooled_width; ++pj) {
+        Scalar best = -std::numeric_limits<Scalar>::infinity();
+        int best_offset = 0;
+        for (int m = 0; m < pool_size; ++m) {
+            for (int n = 0; n < pool_size; ++n) {
+                int index = m * conv_width + pj * pool_stride + n;
+                Scalar value = bias ? conv_rows[index] + bias[index] : conv_rows[index];
+                if (value > best) {
+                    best = value;
+                    best_offset = m * pool_size + n;
+                }
+            }
+        }
+        // max(relu(z)) == relu(max(z)), and a clipped max passes no gradient back
+        bool active = best > 0;
+        out_row[pj] = active ? best : Scalar(0);
+        if (argmax_row) {
+            argmax_row[pj] = active ? static_cast<std::uint8_t>(best_offset) : no_gradient;
+        }
+    }
+}
+
+Tensor FusedConvReLUPool::forward(const Tensor& input) {
+    cached_batch = input.batch();
+    if (training) {
+        argmax.assign((size_t)input.batch() * conv->depth * pooled_height * pooled_width, no_gradient);
+    }
+    if (conv->resolved_algorithm() == ConvAlgorithm::Im2col) {
+        return forward_im2col(input);
+    }
+
+    // Winograd, FFT and Direct produce the whole biased convolution, only the epilogue is fused
+    reserve_conv_scratch(input.batch());
+    Tensor pre_activation = conv->forward(input);
+    Tensor output = make_output(output_shape(input.shape()));
+    ThreadPool::global().parallel_for(0, input.batch() * conv->depth, [&](int task) {
+        const Scalar* plane = pre_activation.channel(task / conv->depth, task % conv->depth).data();
+        Scalar* out = output.channel(task / conv->depth, task % conv->depth).data();
+        std::uint8_t* codes = training ? argmax.data() + (size_t)task * pooled_height * pooled_width : nullptr;
+        for (int pi = 0; pi < pooled_height; ++pi) {
+            pool_row(plane + (long)pi * pool_stride * conv->output_width, nullptr, out + pi * pooled_width,
+                     codes ? codes + pi * pooled_width : nullptr);
+        }
+    });
+    return output;
+}
+
+Tensor FusedConvReLUPool::forward_im2col(const Tensor& input) {
+    const int depth = conv->depth;
+    const int patch = conv->patch_size();
+    const int conv_width = conv->output_width;
+    const int out_size = conv->output_height * conv_width;
+    const int band = pool_size * conv_width;
+
+    // Columns stay behind for the wrapped layer's backward, exactly as its own forward leaves them
+    conv->lower(input);
+
+    Tensor output = make_output(output_shape(input.shape()));
+    auto filters = conv->kernels.matrix(depth, patch);
+    int blocks = conv->filter_blocks(input.batch());
+    ThreadPool::global().parallel_for(0, input.batch() * blocks, [&](int task) {
+        int n = task / blocks;
+        int first = (long)depth * (task % blocks) / blocks;
+        int count = (long)depth * (task % blocks + 1) / blocks - first;
+        auto sample_columns = conv->columns.middleRows((long)n * patch, patch);
+
+        // Scratch for the convolution rows under one band of pooling windows
+        Tensor::MatrixMap rows(thread_scratch<Scalar, BandRows>((size_t)count * band), count, band);
+        for (int pi = 0; pi < pooled_height; ++pi) {
+            int first_row = pi * pool_stride;
+            rows.noalias() = filters.middleRows(first, count) * sample_columns.middleCols((long)first_row * conv_width, band);
+            for (int f = 0; f < count; ++f) {
+                int i = first + f;
+                const Scalar* bias = conv->biases.data() + (long)i * out_size + (long)first_row * conv_width;
+                std::uint8_t* codes = training
+                    ? argmax.data() + (((size_t)n * depth + i) * pooled_height + pi) * pooled_width
+                    : nullptr;
+                pool_row(rows.row(f).data(), bias, output.channel(n, i).data() + pi * pooled_width, codes);
+            }
+        }
+    });
+    return output;
+}
+
+Tensor FusedConvReLUPool::backward(const Tensor& output_gradient) {
+    const int depth = conv->depth;
+    reserve_conv_scratch(cached_batch);
+    Tensor conv_gradient = carve(conv_scratch, {cached_batch, depth, conv->output_height, conv->output_width});
+
+    // Every pooled gradient lands on its window's argmax. Overlapping windows can pick the
+    // same position, so each (sample, filter) plane is accumulated by a single task
+    ThreadPool::global().parallel_for(0, cached_batch * depth, [&](int task) {
+        auto grad_out = output_gradient.channel(task / depth, task % depth);
+        auto grad_in = conv_gradient.channel(task / depth, task % depth);
+        const std::uint8_t* codes = argmax.data() + (size_t)task * pooled_height * pooled_width;
+        for (int pi = 0; pi < pooled_height; ++pi) {
+            for (int pj = 0; pj < pooled_width; ++pj) {
+                std::uint8_t code = codes[pi * pooled_width + pj];
+                if (code != no_gradient) {
+                    grad_in(pi * pool_stride + code / pool_size, pj * pool_stride + code % pool_size) += grad_out(pi, pj);
+                }
+            }
+        }
+    });
+
+    return conv->backward(conv_gradient);
+}
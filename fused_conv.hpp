@@ -0,0 +1,70 @@
+#pragma once
+#include "layer.hpp"
+#include "convolutional.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Convolutional -> ReLU -> MaxPooling as one layer
+ *
+ * Only the pooled output is written. On the Im2col path the GEMM runs one band
+ * of pooled rows at a time into a small scratch block, and bias, ReLU and the
+ * max are applied straight out of it, so neither the convolution output nor the
+ * ReLU output exist at full resolution. Direct, Winograd and FFT still write the
+ * whole (batch, depth, oh, ow) convolution output into conv_scratch and fuse only
+ * the bias/ReLU/pool epilogue, so on those paths the layer saves the ReLU pass and
+ * its buffer but not the convolution-sized intermediate.
+ *
+ * For backward each pooled value remembers its argmax as one byte (offset inside
+ * the pooling window), or no_gradient when the ReLU clipped it. The gradient is
+ * scattered to those positions in conv_scratch (on every path) and handed to the
+ * wrapped Convolutional.
+ *
+ * Network::fuse() swaps matching layer triples for this layer.
+ */
+class FusedConvReLUPool : public Layer {
+public:
+    // Takes over conv (its parameters and settings) followed by max pooling of pool_size with pool_stride
+    FusedConvReLUPool(std::shared_ptr<Convolutional> conv, int pool_size, int pool_stride = -1);
+
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "FusedConvReLUPool"; }
+    void set_training(bool training) override;
+    Tensor::Shape output_shape(const Tensor::Shape& input_shape) const override {
+        return {input_shape[0], conv->depth, pooled_height, pooled_width};
+    }
+    // Parameters are the wrapped layer's
+    std::vector<Tensor*> parameters() override { return conv->parameters(); }
+    std::vector<Tensor*> gradients() override { return conv->gradients(); }
+    // Wraps a clone of the convolution
+    std::shared_ptr<Layer> clone() const override;
+    void parameters_changed() override { conv->parameters_changed(); }
+    // The input gradient is produced by the wrapped layer, so its buffer is passed on
+    void bind_buffers(const Tensor& output_buffer, const Tensor& input_gradient_buffer) override;
+
+    const std::shared_ptr<Convolutional>& convolution() const { return conv; }
+    int pooling_size() const { return pool_size; }
+    int pooling_stride() const { return pool_stride; }
+
+    static constexpr std::uint8_t no_gradient = 255;
+
+private:
+    std::shared_ptr<Convolutional> conv;
+    int pool_size, pool_stride;
+    int pooled_height, pooled_width;
+    // One byte per pooled output, [sample][filter][row][col]
+    std::vector<std::uint8_t> argmax;
+    int cached_batch = 0;
+    // Convolution-sized scratch, grown on demand: the wrapped layer's output on the
+    // non-Im2col paths in forward, the scattered gradient in backward
+    Tensor conv_scratch;
+
+    // Grows conv_scratch to fit batch samples and hands it to the wrapped layer as its output buffer
+    void reserve_conv_scratch(int batch);
+    // Bias, ReLU and max pooling for pooled row pi of one filter. conv_rows holds the
+    // pool_size convolution rows the band covers, bias the matching bias rows (or null)
+    void pool_row(const Scalar* conv_rows, const Scalar* bias, Scalar* out_row, std::uint8_t* argmax_row) const;
+    Tensor forward_im2col(const Tensor& input);
+};
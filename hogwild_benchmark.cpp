@@ -0,0 +1,122 @@
+// Convergence and throughput of Hogwild against synchronous data-parallel training on MNIST.
+// Both start from the same weights and see the same number of batches per epoch.
+// Usage: ./hogwild_benchmark [threads] [epochs] [samples]
+#include "network.hpp"
+#include "dense.hpp"
+#include "convolutional.hpp"
+#include "reshape.hpp"
+#include "activations.hpp"
+#include "losses.hpp"
+#include "dataloader.hpp"
+#include "idx.hpp"
+#include "thread_pool.hpp"
+#include "pooling.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    std::vector<std::shared_ptr<Layer>> mnist_layers() {
+        return {
+            std::make_shared<Convolutional>(std::vector<int>{1,28,28}, 3, 5, 1, 0),
+            std::make_shared<AveragePooling>(6,4),
+            std::make_shared<Sigmoid>(),
+            std::make_shared<Reshape>(std::vector<int>{5,6,6}, std::vector<int>{1,5*6*6,1}),
+            std::make_shared<Dense>(5*6*6, 36),
+            std::make_shared<Sigmoid>(),
+            std::make_shared<Dense>(36, 10),
+            std::make_shared<Softmax>()
+        };
+    }
+
+    double accuracy(Network& network, const IdxFile& images, const IdxFile& labels, int num_samples) {
+        Network::InferenceMode inference(network);
+        DataLoader loader(images, labels, 64, 10, false, num_samples);
+        int correct = 0;
+        while (loader.has_next_batch()) {
+            auto [batch_x, batch_y] = loader.get_next_batch();
+            Tensor output = network.predict(batch_x);
+            for (int i = 0; i < output.batch(); ++i) {
+                int predicted_label, true_label;
+                output.channel(i, 0).col(0).maxCoeff(&predicted_label);
+                batch_y.channel(i, 0).col(0).maxCoeff(&true_label);
+                if (predicted_label == true_label) correct++;
+            }
+        }
+        return 100.0 * correct / num_samples;
+    }
+}
+
+int main(int argc, char** argv) {
+    int threads = argc > 1 ? std::atoi(argv[1]) : static_cast<int>(std::thread::hardware_concurrency());
+    int epochs = argc > 2 ? std::atoi(argv[2]) : 5;
+    int num_train = argc > 3 ? std::atoi(argv[3]) : 6000;
+    ThreadPool::set_num_threads(threads);
+
+    IdxFile train_images("train-images.idx3-ubyte");
+    IdxFile train_labels("train-labels.idx1-ubyte");
+    num_train = std::min<long>(num_train, train_images.count());
+
+    // Small batches: Hogwild workers step after every one of them
+    int batch_size = 8;
+    double learning_rate = 0.1;
+    DataLoader train_loader(train_images, train_labels, batch_size, 10, true, num_train);
+
+    Network synchronous(mnist_layers());
+    Network hogwild(mnist_layers());
+    // Same starting point for both
+    const auto& from = synchronous.get_layers();
+    const auto& to = hogwild.get_layers();
+    for (size_t i = 0; i < from.size(); ++i) {
+        std::vector<Tensor*> source = from[i]->parameters(), target = to[i]->parameters();
+        for (size_t k = 0; k < source.size(); ++k) {
+            target[k]->flat() = source[k]->flat();
+        }
+        to[i]->parameters_changed();
+    }
+    synchronous.set_data_parallel(threads);
+
+    std::cout << threads << " threads, " << num_train << " samples, batches of " << batch_size << "\n";
+    std::cout << std::fixed << std::setprecision(4);
+    for (int mode = 0; mode < 2; ++mode) {
+        Network& network = mode == 0 ? synchronous : hogwild;
+        std::string name = mode == 0 ? "synchronous" : "hogwild";
+        double total_seconds = 0;
+        for (int epoch = 0; epoch < epochs; ++epoch) {
+            train_loader.reset();
+            auto start = std::chrono::steady_clock::now();
+            double epoch_loss = 0;
+            if (mode == 0) {
+                while (train_loader.has_next_batch()) {
+                    auto [batch_x, batch_y] = train_loader.get_next_batch();
+                    epoch_loss += batch_x.batch() * network.train_batch(batch_x, batch_y,
+                                                                         Loss::cross_entropy_loss,
+                                                                         Loss::cross_entropy_loss_prime,
+                                                                         learning_rate);
+                }
+                epoch_loss /= num_train;
+            } else {
+                epoch_loss = network.train_hogwild(train_loader.get_num_batches(),
+                                                   [&](int b) { return train_loader.get_batch(b); },
+                                                   Loss::cross_entropy_loss,
+                                                   Loss::cross_entropy_loss_prime,
+                                                   learning_rate,
+                                                   threads);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            total_seconds += seconds;
+            std::cout << name << " epoch " << epoch + 1 << "/" << epochs << " - Loss: " << epoch_loss
+                      << " - " << seconds << " s (" << num_train / seconds << " samples/s)" << std::endl;
+        }
+        std::cout << name << ": " << total_seconds << " s, " << epochs * num_train / total_seconds
+                  << " samples/s, training accuracy " << accuracy(network, train_images, train_labels, num_train)
+                  << "%\n\n";
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "idx.hpp"
+#include <climits>
+#include <stdexcept>
+
+namespace {
+    constexpr std::uint8_t unsigned_byte = 0x08;
+
+    std::uint32_t big_endian(std::uint32_t stored) {
+        const auto* bytes = reinterpret_cast<const std::uint8_t*>(&stored);
+        return (std::uint32_t(bytes[0]) << 24) | (std::uint32_t(bytes[1]) << 16) | (std::uint32_t(bytes[2]) << 8) | bytes[3];
+    }
+}
+
+IdxFile::IdxFile(const std::string& path) : file(std::make_shared<MappedFile>(path)) {
+    MappedReader reader(*file);
+    std::uint8_t magic[4];
+    for (auto& byte : magic) {
+        byte = reader.read<std::uint8_t>();
+    }
+    if (magic[0] != 0 || magic[1] != 0) {
+        throw std::runtime_error(path + ": not an IDX file");
+    }
+    if (magic[2] != unsigned_byte) {
+        throw std::runtime_error(path + ": unsupported IDX data type " + std::to_string(magic[2]) + ", only unsigned byte is read");
+    }
+    if (magic[3] == 0) {
+        throw std::runtime_error(path + ": IDX file without dimensions");
+    }
+
+    std::uint64_t total = 1;
+    for (int i = 0; i < magic[3]; i++) {
+        std::uint32_t dimension = big_endian(reader.read<std::uint32_t>());
+        if (dimension > static_cast<std::uint32_t>(INT_MAX)) {
+            throw std::runtime_error(path + ": IDX dimension " + std::to_string(dimension) + " is too large");
+        }
+        if (dimension != 0 && total > file->size() / dimension) {
+            throw std::runtime_error(path + ": IDX dimensions describe more data than the file holds");
+        }
+        dimensions.push_back(static_cast<int>(dimension));
+        total *= dimension;
+        if (i > 0) {
+            item_bytes *= dimension;
+        }
+    }
+    data_offset = reader.position();
+    if (total != file->size() - data_offset) {
+        throw std::runtime_error(path + ": IDX header promises " + std::to_string(total) + " bytes of data but the file has " +
+                                 std::to_string(file->size() - data_offset));
+    }
+}
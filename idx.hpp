@@ -0,0 +1,44 @@
+#pragma once
+#include "mapped_file.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A memory-mapped IDX file, the format MNIST and its variants ship in
+ *
+ * Layout (big-endian header):
+ *
+ *   magic       two zero bytes, a type code (0x08 = unsigned byte), the number of dimensions
+ *   dimensions  one uint32 per dimension, the first being the item count
+ *   data        every item back to back, row-major
+ *
+ * Only unsigned byte data is supported, which is what image and label files use.
+ * The constructor validates the header and that the data fills the file exactly;
+ * after that the items are read in place from the mapping, so opening even the
+ * 60000 MNIST training images costs a few page-table entries.
+ */
+class IdxFile {
+public:
+    // Throws std::runtime_error if the file is unreadable, not unsigned byte IDX, or truncated
+    explicit IdxFile(const std::string& path);
+
+    // dims()[0] is the number of items, the rest is the shape of one item
+    const std::vector<int>& dims() const { return dimensions; }
+    int count() const { return dimensions[0]; }
+    // Bytes per item: the product of every dimension but the first
+    std::size_t item_size() const { return item_bytes; }
+
+    const std::uint8_t* data() const { return file->data() + data_offset; }
+    const std::uint8_t* item(int index) const { return data() + index * item_bytes; }
+
+    // Owner of the mapping, to keep pointers into data() valid after this object is gone
+    std::shared_ptr<const MappedFile> mapping() const { return file; }
+
+private:
+    std::shared_ptr<MappedFile> file;
+    std::vector<int> dimensions;
+    std::size_t item_bytes = 1;
+    std::size_t data_offset = 0;
+};
@@ -0,0 +1,124 @@
+// IdxFile header validation and DataLoader batches from IDX files, on small synthetic files
+// written next to the binary and removed afterwards.
+// Build and run with `make test_idx`; exits non-zero if any check fails
+#include "dataloader.hpp"
+#include "idx.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    int failures = 0;
+
+    void check(bool ok, const std::string& what) {
+        std::cout << (ok ? "ok   " : "FAIL ") << what << "\n";
+        if (!ok) {
+            failures++;
+        }
+    }
+
+    // True if body throws std::runtime_error
+    bool throws(const std::function<void()>& body) {
+        try {
+            body();
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    }
+
+    // Unsigned byte IDX: magic, big-endian dimensions, then data
+    std::vector<std::uint8_t> idx_bytes(const std::vector<std::uint32_t>& dims, const std::vector<std::uint8_t>& data) {
+        std::vector<std::uint8_t> bytes = {0, 0, 0x08, static_cast<std::uint8_t>(dims.size())};
+        for (std::uint32_t d : dims) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                bytes.push_back(static_cast<std::uint8_t>(d >> shift));
+            }
+        }
+        bytes.insert(bytes.end(), data.begin(), data.end());
+        return bytes;
+    }
+
+    std::vector<std::string> written;
+
+    std::string write(const std::string& name, const std::vector<std::uint8_t>& bytes) {
+        std::string path = "idx_test_" + name;
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        written.push_back(path);
+        return path;
+    }
+}
+
+int main() {
+    const int count = 37, height = 5, width = 7, num_classes = 10;
+    std::vector<std::uint8_t> pixels(count * height * width), labels(count);
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        pixels[i] = static_cast<std::uint8_t>(i * 31 % 256);
+    }
+    for (int i = 0; i < count; ++i) {
+        labels[i] = static_cast<std::uint8_t>(i * 7 % num_classes);
+    }
+    std::vector<std::uint8_t> image_file = idx_bytes({count, height, width}, pixels);
+    std::vector<std::uint8_t> label_file = idx_bytes({count}, labels);
+    std::string images_path = write("images", image_file);
+    std::string labels_path = write("labels", label_file);
+
+    std::cout << "=== Header ===\n";
+    IdxFile images(images_path);
+    IdxFile label_items(labels_path);
+    check(images.dims() == std::vector<int>{count, height, width}, "image dimensions read from the header");
+    check(images.count() == count && images.item_size() == size_t(height * width), "image count and item size");
+    check(images.item(3)[2] == pixels[3 * height * width + 2], "items read in place");
+
+    std::vector<std::uint8_t> bad = image_file;
+    bad[0] = 0x1F;
+    check(throws([&] { IdxFile file(write("magic", bad)); }), "wrong magic rejected");
+    bad = image_file;
+    bad[2] = 0x0D;
+    check(throws([&] { IdxFile file(write("float", bad)); }), "non-byte data type rejected");
+    bad.assign(image_file.begin(), image_file.end() - 1);
+    check(throws([&] { IdxFile file(write("truncated", bad)); }), "truncated data rejected");
+    bad.assign(image_file.begin(), image_file.begin() + 10);
+    check(throws([&] { IdxFile file(write("short_header", bad)); }), "truncated header rejected");
+    bad = image_file;
+    bad.push_back(0);
+    check(throws([&] { IdxFile file(write("trailing", bad)); }), "trailing bytes rejected");
+    IdxFile fewer_labels(write("fewer_labels", idx_bytes({count - 1}, std::vector<std::uint8_t>(labels.begin(), labels.end() - 1))));
+    check(throws([&] { DataLoader loader(images, fewer_labels, 8, num_classes, false); }), "label count mismatch rejected");
+
+    std::cout << "\n=== Batches ===\n";
+    DataLoader loader(images, label_items, 8, num_classes, false);
+    bool pixels_match = true, labels_match = true;
+    int seen = 0;
+    while (loader.has_next_batch()) {
+        auto [x, y] = loader.get_next_batch();
+        for (int n = 0; n < x.batch(); ++n, ++seen) {
+            for (int r = 0; r < height; ++r) {
+                for (int c = 0; c < width; ++c) {
+                    Scalar expected = Scalar(pixels[(seen * height + r) * width + c]) / 255;
+                    // Normalisation multiplies by 1 / 255, so allow the last bit
+                    pixels_match = pixels_match && std::abs(x(n, 0, r, c) - expected) <= 1e-6;
+                }
+            }
+            for (int k = 0; k < num_classes; ++k) {
+                labels_match = labels_match && y(n, 0, k, 0) == (k == labels[seen] ? 1 : 0);
+            }
+        }
+    }
+    check(seen == count, "every image batched once");
+    check(pixels_match, "batch values are pixel / 255");
+    check(labels_match, "labels one-hot encoded");
+
+    for (const std::string& path : written) {
+        std::remove(path.c_str());
+    }
+    std::cout << "\n" << (failures ? "FAILED " + std::to_string(failures) + " checks" : std::string("all passed")) << "\n";
+    return failures ? 1 : 0;
+}
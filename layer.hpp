@@ -1,14 +1,91 @@
 #pragma once
-#include <Eigen/Dense>
+#include "tensor.hpp"
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
+// Activations flow between layers as NCHW tensors: [batch][channels][height][width]
 class Layer {
 public:
     virtual ~Layer() = default;
-    virtual std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) = 0;
-    virtual std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) = 0;
-    
+    virtual Tensor forward(const Tensor& input) = 0;
+    // Returns the gradient wrt forward's input and adds the parameter gradients to gradients(),
+    // so several backward calls sum up until zero_gradients(). Parameters are not touched,
+    // Network applies its Optimizer once it is told to step
+    virtual Tensor backward(const Tensor& output_gradient) = 0;
+    // Type name shown in profiler reports and recorded in checkpoints
+    virtual std::string name() const { return "Layer"; }
+
+    // Trainable tensors in a fixed order. Checkpoints save and restore them by position,
+    // and may replace them outright (with views into a mapped file), so callers that do
+    // must follow up with parameters_changed()
+    virtual std::vector<Tensor*> parameters() { return {}; }
+    // Gradients of the loss wrt parameters(), same order and shapes, accumulated by backward.
+    // Like parameters, Network may repoint them (into its packed gradient storage), so
+    // backward must add into them in place rather than assign new tensors
+    virtual std::vector<Tensor*> gradients() { return {}; }
+    void zero_gradients() {
+        for (Tensor* gradient : gradients()) {
+            gradient->set_zero();
+        }
+    }
+    // Drops anything derived from the parameters after they were written from outside
+    virtual void parameters_changed() {}
+
+    // A new layer of the same type and configuration whose parameters() share this layer's
+    // storage, with gradients, caches and buffers of its own. Network trains data-parallel
+    // replicas made this way. Training mode is not carried over
+    virtual std::shared_ptr<Layer> clone() const {
+        throw std::logic_error(name() + " cannot be cloned");
+    }
+
+    // Training mode (the default) keeps whatever backward needs from each forward pass.
+    // Inference mode keeps nothing, so an activation's memory can be reused as soon as the next layer is done with it.
+    // Bound buffers were planned for one mode, so switching drops them
+    virtual void set_training(bool training) {
+        this->training = training;
+        output_buffer = Tensor();
+        input_gradient_buffer = Tensor();
+        if (!training) {
+            input = Tensor();
+            output = Tensor();
+        }
+    }
+    bool is_training() const { return training; }
+
+    // Shape inference: what forward returns for an input of input_shape. The default fits element-wise layers
+    virtual Tensor::Shape output_shape(const Tensor::Shape& input_shape) const { return input_shape; }
+    // True when forward returns a view of its input and backward a view of its gradient,
+    // so neither needs memory of its own
+    virtual bool returns_views() const { return false; }
+
+    // Memory planned by Network for forward's output and backward's input gradient. Either may be
+    // empty, and a buffer too small for the actual shape is ignored, so the layer then allocates
+    virtual void bind_buffers(const Tensor& output_buffer, const Tensor& input_gradient_buffer) {
+        this->output_buffer = output_buffer;
+        this->input_gradient_buffer = input_gradient_buffer;
+    }
+
 protected:
-    std::vector<Eigen::MatrixXd> input;
-    std::vector<Eigen::MatrixXd> output;
-}; 
\ No newline at end of file
+    Tensor input;
+    Tensor output;
+    bool training = true;
+
+    Tensor output_buffer;
+    Tensor input_gradient_buffer;
+
+    // Zeroed tensors for forward's output and backward's input gradient, taken from the bound buffer when it fits
+    Tensor make_output(const Tensor::Shape& shape) const { return carve(output_buffer, shape); }
+    Tensor make_input_gradient(const Tensor::Shape& shape) const { return carve(input_gradient_buffer, shape); }
+
+    static Tensor carve(const Tensor& buffer, const Tensor::Shape& shape) {
+        long size = (long)shape[0] * shape[1] * shape[2] * shape[3];
+        if (size == 0 || buffer.size() < size) {
+            return Tensor(shape);
+        }
+        Tensor result = buffer.view(0, shape);
+        result.set_zero();
+        return result;
+    }
+};
@@ -1,73 +1,54 @@
 #include "losses.hpp"
 #include <cmath>
 
+// Losses are averaged over every (sample, channel) plane of the tensors, and the
+// gradients are divided by the batch size so one update uses the mean over the batch
 namespace Loss {
-    double mse(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred) {
-        double loss = 0.0;
-        for (size_t i = 0; i < y_true.size(); ++i) {
-            loss += (y_true[i] - y_pred[i]).array().square().sum();
-        }
-        return loss / y_true.size();
+    double mse(const Tensor& y_true, const Tensor& y_pred) {
+        double loss = (y_true.flat() - y_pred.flat()).array().square().sum();
+        return loss / (y_true.batch() * y_true.channels());
     }
 
-    std::vector<Eigen::MatrixXd> mse_prime(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred) {
-        std::vector<Eigen::MatrixXd> grad(y_true.size());
-        for (size_t i = 0; i < y_true.size(); ++i) {
-            grad[i] = 2.0 * (y_pred[i] - y_true[i]) / y_true[i].rows();
-        }
+    Tensor mse_prime(const Tensor& y_true, const Tensor& y_pred) {
+        Tensor grad(y_true.shape());
+        grad.flat() = 2.0 * (y_pred.flat() - y_true.flat()) / (y_true.batch() * y_true.height());
         return grad;
     }
 
-    double binary_cross_entropy(const std::vector<Eigen::MatrixXd>& y_true, 
-                              const std::vector<Eigen::MatrixXd>& y_pred) {
+    double binary_cross_entropy(const Tensor& y_true, const Tensor& y_pred) {
         double loss = 0.0;
-        for (size_t i = 0; i < y_true.size(); ++i) {
-            for (int j = 0; j < y_true[i].rows(); ++j) {
-                for (int k = 0; k < y_true[i].cols(); ++k) {
-                    double y = y_true[i](j, k);
-                    double p = y_pred[i](j, k);
-                    // Add small epsilon to avoid log(0)
-                    loss += -(y * std::log(p + 1e-15) + (1 - y) * std::log(1 - p + 1e-15));
-                }
-            }
+        for (long i = 0; i < y_true.size(); ++i) {
+            double y = y_true.data()[i];
+            double p = y_pred.data()[i];
+            // Add small epsilon to avoid log(0)
+            loss += -(y * std::log(p + 1e-15) + (1 - y) * std::log(1 - p + 1e-15));
         }
-        return loss / y_true.size();
+        return loss / (y_true.batch() * y_true.channels());
     }
 
-    std::vector<Eigen::MatrixXd> binary_cross_entropy_prime(const std::vector<Eigen::MatrixXd>& y_true, 
-                                                          const std::vector<Eigen::MatrixXd>& y_pred) {
-        std::vector<Eigen::MatrixXd> grad(y_true.size());
-        for (size_t i = 0; i < y_true.size(); ++i) {
-            grad[i] = Eigen::MatrixXd::Zero(y_true[i].rows(), y_true[i].cols());
-            for (int j = 0; j < y_true[i].rows(); ++j) {
-                for (int k = 0; k < y_true[i].cols(); ++k) {
-                    double y = y_true[i](j, k);
-                    double p = y_pred[i](j, k);
-                    // Add small epsilon to avoid division by zero
-                    grad[i](j, k) = -(y / (p + 1e-15) - (1 - y) / (1 - p + 1e-15));
-                }
-            }
+    Tensor binary_cross_entropy_prime(const Tensor& y_true, const Tensor& y_pred) {
+        Tensor grad(y_true.shape());
+        for (long i = 0; i < y_true.size(); ++i) {
+            double y = y_true.data()[i];
+            double p = y_pred.data()[i];
+            // Add small epsilon to avoid division by zero
+            grad.data()[i] = static_cast<Scalar>(-(y / (p + 1e-15) - (1 - y) / (1 - p + 1e-15)) / y_true.batch());
         }
         return grad;
     }
 
-    double cross_entropy_loss(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred) {
-        const double epsilon = 1e-15;
-        double loss = 0.0;
-        for (size_t i = 0; i < y_true.size(); ++i) {
-            Eigen::MatrixXd clipped_pred = y_pred[i].array().max(epsilon).min(1 - epsilon);
-            loss += -(y_true[i].array() * clipped_pred.array().log()).sum();
-        }
-        return loss / y_true.size();
+    double cross_entropy_loss(const Tensor& y_true, const Tensor& y_pred) {
+        const Scalar epsilon = Scalar(1e-15);
+        auto clipped_pred = y_pred.flat().array().max(epsilon).min(1 - epsilon);
+        double loss = -(y_true.flat().array() * clipped_pred.log()).sum();
+        return loss / (y_true.batch() * y_true.channels());
     }
 
-    std::vector<Eigen::MatrixXd> cross_entropy_loss_prime(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred) {
-        const double epsilon = 1e-15;
-        std::vector<Eigen::MatrixXd> grad(y_true.size());
-        for (size_t i = 0; i < y_true.size(); ++i) {
-            Eigen::MatrixXd clipped_pred = y_pred[i].array().max(epsilon).min(1 - epsilon);
-            grad[i] = (clipped_pred - y_true[i]) / y_true[i].rows();
-        }
+    Tensor cross_entropy_loss_prime(const Tensor& y_true, const Tensor& y_pred) {
+        const Scalar epsilon = Scalar(1e-15);
+        Tensor grad(y_true.shape());
+        auto clipped_pred = y_pred.flat().array().max(epsilon).min(1 - epsilon);
+        grad.flat() = (clipped_pred - y_true.flat().array()).matrix() / (y_true.batch() * y_true.height());
         return grad;
     }
-}
\ No newline at end of file
+}
@@ -1,13 +1,13 @@
 #pragma once
-#include <Eigen/Dense>
+#include "tensor.hpp"
 
 namespace Loss {
-    double mse(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred);
-    std::vector<Eigen::MatrixXd> mse_prime(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred);
+    double mse(const Tensor& y_true, const Tensor& y_pred);
+    Tensor mse_prime(const Tensor& y_true, const Tensor& y_pred);
     
-    double binary_cross_entropy(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred);
-    std::vector<Eigen::MatrixXd> binary_cross_entropy_prime(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred);
+    double binary_cross_entropy(const Tensor& y_true, const Tensor& y_pred);
+    Tensor binary_cross_entropy_prime(const Tensor& y_true, const Tensor& y_pred);
 
-    double cross_entropy_loss(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred);
-    std::vector<Eigen::MatrixXd> cross_entropy_loss_prime(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred);
+    double cross_entropy_loss(const Tensor& y_true, const Tensor& y_pred);
+    Tensor cross_entropy_loss_prime(const Tensor& y_true, const Tensor& y_pred);
 } 
\ No newline at end of file
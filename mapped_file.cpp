@@ -0,0 +1,47 @@
+#include "mapped_file.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) : file_path(path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Cannot stat " + path + ": " + std::strerror(error));
+    }
+    length = static_cast<std::size_t>(info.st_size);
+    if (length > 0) {
+        void* mapped = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Cannot map " + path + ": " + std::strerror(error));
+        }
+        bytes = static_cast<std::uint8_t*>(mapped);
+    }
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+}
+
+void MappedReader::bytes(void* out, std::size_t count) {
+    if (offset > file.size() || count > file.size() - offset) {
+        throw std::runtime_error(file.path() + ": unexpected end of file");
+    }
+    std::memcpy(out, file.data() + offset, count);
+    offset += count;
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) {
+        ::munmap(bytes, length);
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * @brief A whole file mapped into memory, unmapped on destruction
+ *
+ * The mapping is private and writable: pages are shared with the page cache (and
+ * so with every other process mapping the same file) until something writes to
+ * them, at which point the writer gets its own copy. The file itself never changes.
+ *
+ * Hold it in a std::shared_ptr and pass that as the owner of Tensor::external
+ * views to keep the mapping alive exactly as long as they are.
+ */
+class MappedFile {
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::uint8_t* data() { return bytes; }
+    const std::uint8_t* data() const { return bytes; }
+    std::size_t size() const { return length; }
+    const std::string& path() const { return file_path; }
+
+private:
+    std::uint8_t* bytes = nullptr;
+    std::size_t length = 0;
+    std::string file_path;
+};
+
+// Bounds-checked sequential reads of fixed-width fields out of a mapping, for parsing headers.
+// Throws std::runtime_error once a read would run past the end of the file
+class MappedReader {
+public:
+    explicit MappedReader(const MappedFile& file, std::size_t position = 0) : file(file), offset(position) {}
+
+    template <class T>
+    T read() {
+        T value;
+        bytes(&value, sizeof(T));
+        return value;
+    }
+    std::string read_string(std::uint32_t length) {
+        std::string text(length, '\0');
+        bytes(&text[0], length);
+        return text;
+    }
+    std::size_t position() const { return offset; }
+
+private:
+    const MappedFile& file;
+    std::size_t offset;
+
+    void bytes(void* out, std::size_t count);
+};
@@ -0,0 +1,47 @@
+#include "memory_plan.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace MemoryPlan {
+    long assign_offsets(std::vector<Buffer>& buffers, long alignment) {
+        auto align = [alignment](long n) { return (n + alignment - 1) / alignment * alignment; };
+
+        std::vector<size_t> order(buffers.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return buffers[a].size > buffers[b].size;
+        });
+
+        std::vector<size_t> placed;
+        long arena_size = 0;
+        for (size_t index : order) {
+            Buffer& buffer = buffers[index];
+
+            // Placed buffers that are live at the same time, by offset
+            std::vector<size_t> conflicts;
+            for (size_t other : placed) {
+                const Buffer& p = buffers[other];
+                if (p.first_use <= buffer.last_use && buffer.first_use <= p.last_use) {
+                    conflicts.push_back(other);
+                }
+            }
+            std::sort(conflicts.begin(), conflicts.end(), [&](size_t a, size_t b) {
+                return buffers[a].offset < buffers[b].offset;
+            });
+
+            // First gap big enough
+            long offset = 0;
+            for (size_t other : conflicts) {
+                const Buffer& p = buffers[other];
+                if (offset + buffer.size <= p.offset) {
+                    break;
+                }
+                offset = std::max(offset, align(p.offset + p.size));
+            }
+            buffer.offset = offset;
+            placed.push_back(index);
+            arena_size = std::max(arena_size, align(offset + buffer.size));
+        }
+        return arena_size;
+    }
+}
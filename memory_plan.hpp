@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+
+/**
+ * @brief Static offset assignment for buffers with known lifetimes
+ *
+ * Each buffer is live over an inclusive range of steps. Buffers whose ranges
+ * overlap get disjoint pieces of one arena, the others may share memory.
+ * Placement is greedy by size (largest first, at the lowest offset that does
+ * not collide with an overlapping buffer), which in practice lands close to
+ * the peak of simultaneously live elements.
+ */
+namespace MemoryPlan {
+    struct Buffer {
+        long size = 0;      // Elements
+        int first_use = 0;  // Steps, inclusive
+        int last_use = 0;
+        long offset = 0;    // Set by assign_offsets: element offset into the arena
+    };
+
+    // Sets every buffer's offset, each a multiple of alignment elements, and returns the arena size
+    long assign_offsets(std::vector<Buffer>& buffers, long alignment);
+}
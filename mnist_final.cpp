@@ -5,6 +5,8 @@
 #include "activations.hpp"
 #include "losses.hpp"
 #include "dataloader.hpp"
+#include "idx.hpp"
+#include "thread_pool.hpp"
 #include "pooling.hpp"
 #include <iostream>
 #include <fstream>
@@ -12,56 +14,19 @@
 #include <memory>
 #include <random>
 #include <algorithm>
-
-// Function to load MNIST images
-std::vector<Eigen::MatrixXd> load_mnist_images(const std::string& path, int num_images) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open())
-        throw std::runtime_error("Cannot open image file " + path);
-
-    file.ignore(16);  // Skip MNIST header (always present)
-
-    std::vector<Eigen::MatrixXd> images;
-    for (int i = 0; i < num_images; ++i) {
-        Eigen::MatrixXd image(28, 28);
-        for (int r = 0; r < 28; ++r)
-            for (int c = 0; c < 28; ++c) {
-                unsigned char pixel;
-                file.read(reinterpret_cast<char*>(&pixel), sizeof(pixel));
-                image(r, c) = static_cast<double>(pixel) / 255.0;
-            }
-        images.push_back(image);
-    }
-    file.close();
-    return images;
-}
-
-// Function to load MNIST labels
-std::vector<int> load_mnist_labels(const std::string& path, int num_labels) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open())
-        throw std::runtime_error("Cannot open label file " + path);
-
-    file.ignore(8);  // Skip MNIST header (always present)
-
-    std::vector<int> labels(num_labels);
-    for (int i = 0; i < num_labels; ++i) {
-        unsigned char label;
-        file.read(reinterpret_cast<char*>(&label), sizeof(label));
-        labels[i] = static_cast<int>(label);
-    }
-    file.close();
-    return labels;
-}
+#include <thread>
 
 int main() {
-    // Load MNIST data
+    // Run the convolutional layers on every core
+    ThreadPool::set_num_threads(std::thread::hardware_concurrency());
+
+    // Load MNIST data: both files are mapped and their headers checked, pixels are read in place
     int num_train = 600;  // Using smaller set for quicker demonstration
-    auto train_images = load_mnist_images("train-images.idx3-ubyte", num_train);
-    auto train_labels = load_mnist_labels("train-labels.idx1-ubyte", num_train);
+    IdxFile train_images("train-images.idx3-ubyte");
+    IdxFile train_labels("train-labels.idx1-ubyte");
 
     int batch_size = 32;
-    DataLoader train_loader(train_images, train_labels, batch_size, 10, true);
+    DataLoader train_loader(train_images, train_labels, batch_size, 10, true, num_train);
 
     // Define CNN
     std::vector<std::shared_ptr<Layer>> layers = {
@@ -76,6 +41,7 @@ int main() {
     };
 
     Network network(layers);
+    network.set_profiling(true);
 
     // Train the network
     int epochs = 100;
@@ -84,33 +50,39 @@ int main() {
     for (int epoch = 0; epoch < epochs; ++epoch) {
         train_loader.reset();
         double epoch_loss = 0;
+        int seen = 0;
 
         for (int b = 0; b < train_loader.get_num_batches(); ++b) {
             auto [batch_x, batch_y] = train_loader.get_next_batch();
-            network.train(batch_x, batch_y,
-                          Loss::cross_entropy_loss,
-                          Loss::cross_entropy_loss_prime,
-                          1, learning_rate, false);
-
-            for (size_t i = 0; i < batch_x.size(); ++i) {
-                auto prediction = network.predict(batch_x[i]);
-                loss = Loss::cross_entropy_loss(batch_y[i], prediction);
-                std::cout << "Loss " << loss << std::endl; 
-                epoch_loss += loss;
-            }
+            // One forward, backward and update for the whole batch
+            loss = network.train_batch(batch_x, batch_y,
+                                       Loss::cross_entropy_loss,
+                                       Loss::cross_entropy_loss_prime,
+                                       learning_rate);
+            std::cout << "Loss " << loss << std::endl; 
+            epoch_loss += loss * batch_x.batch();
+            seen += batch_x.batch();
         }
 
-        epoch_loss /= (train_loader.get_num_batches() * batch_size);
+        // The last batch can be short, so average over the samples actually seen
+        epoch_loss /= seen;
         std::cout << "Epoch " << epoch + 1 << "/" << epochs << " - Loss: " << epoch_loss << std::endl;
     }
+    network.print_profile();
 
     // Simple evaluation on training set
+    network.set_training(false);
     int correct = 0;
-    for (int i = 0; i < num_train; ++i) {
-        auto output = network.predict({train_images[i]});
-        int predicted_label;
-        output[0].col(0).maxCoeff(&predicted_label);
-        if (predicted_label == train_labels[i]) correct++;
+    DataLoader eval_loader(train_images, train_labels, batch_size, 10, false, num_train);
+    while (eval_loader.has_next_batch()) {
+        auto [batch_x, batch_y] = eval_loader.get_next_batch();
+        auto output = network.predict(batch_x);
+        for (int i = 0; i < output.batch(); ++i) {
+            int predicted_label, true_label;
+            output.channel(i, 0).col(0).maxCoeff(&predicted_label);
+            batch_y.channel(i, 0).col(0).maxCoeff(&true_label);
+            if (predicted_label == true_label) correct++;
+        }
     }
 
     std::cout << "Training accuracy: " << (double(correct) / num_train) * 100 << "%" << std::endl;
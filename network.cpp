@@ -1,19 +1,159 @@
 #include "network.hpp"
+#include "activations.hpp"
+#include "checkpoint.hpp"
+#include "convolutional.hpp"
+#include "fused_conv.hpp"
+#include "memory_plan.hpp"
+#include "pooling.hpp"
+#include "thread_pool.hpp"
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
 
-Network::Network(const std::vector<std::shared_ptr<Layer>>& layers, bool debug) : layers(layers), debug(debug) {}
-Network::Network(const std::vector<std::shared_ptr<Layer>>& layers) : layers(layers), debug(false) {}
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double seconds_since(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Splits cost into parts contiguous non-empty runs with the smallest largest sum.
+    // Returns where every run begins, then cost.size()
+    std::vector<int> balanced_partition(const std::vector<double>& cost, int parts) {
+        const int n = static_cast<int>(cost.size());
+        std::vector<double> prefix(n + 1, 0);
+        for (int i = 0; i < n; ++i) {
+            prefix[i + 1] = prefix[i] + cost[i];
+        }
+        // best[k][j]: largest run sum when the first j layers make k runs, cut[k][j]: where the last begins
+        const double infinity = std::numeric_limits<double>::infinity();
+        std::vector<std::vector<double>> best(parts + 1, std::vector<double>(n + 1, infinity));
+        std::vector<std::vector<int>> cut(parts + 1, std::vector<int>(n + 1, 0));
+        best[0][0] = 0;
+        for (int k = 1; k <= parts; ++k) {
+            for (int j = k; j <= n; ++j) {
+                for (int i = k - 1; i < j; ++i) {
+                    double largest = std::max(best[k - 1][i], prefix[j] - prefix[i]);
+                    if (largest < best[k][j]) {
+                        best[k][j] = largest;
+                        cut[k][j] = i;
+                    }
+                }
+            }
+        }
+        std::vector<int> begin(parts + 1, n);
+        for (int k = parts, j = n; k > 0; --k) {
+            j = cut[k][j];
+            begin[k - 1] = j;
+        }
+        return begin;
+    }
+
+    long element_count(const Tensor::Shape& shape) {
+        return (long)shape[0] * shape[1] * shape[2] * shape[3];
+    }
+}
+
+Network::Network(const std::vector<std::shared_ptr<Layer>>& layers, bool debug)
+    : layers(layers), debug(debug), optimizer(std::make_shared<SGD>()) {}
+Network::Network(const std::vector<std::shared_ptr<Layer>>& layers)
+    : layers(layers), debug(false), optimizer(std::make_shared<SGD>()) {}
 
 // Function to print layer dimensions for debugging
-void print_layer_dimensions(const std::vector<Eigen::MatrixXd>& data, const std::string& layer_name) {
-    std::cout << layer_name << " dimensions: " << data.size() << " channels" << std::endl;
+void print_layer_dimensions(const Tensor& data, const std::string& layer_name) {
+    std::cout << layer_name << " dimensions: " << data.batch() << " samples, " << data.channels() << " channels" << std::endl;
     if (!data.empty()) {
-        std::cout << "First channel dimensions: " << data[0].rows() << "x" << data[0].cols() << std::endl;
+        std::cout << "Channel dimensions: " << data.height() << "x" << data.width() << std::endl;
     }
 }
 
-std::vector<Eigen::MatrixXd> Network::predict(const std::vector<Eigen::MatrixXd>& input) {
-    std::vector<Eigen::MatrixXd> output = input;
+void Network::plan_memory(const Tensor::Shape& input_shape) {
+    // Smaller batches of the same sample shape fit in the front of every planned buffer
+    bool same_sample = std::equal(input_shape.begin() + 1, input_shape.end(), planned_shape.begin() + 1);
+    if (memory_planned && same_sample && input_shape[0] <= planned_shape[0] && planned_training == training) {
+        return;
+    }
+    Tensor::Shape shape = input_shape;
+    if (memory_planned && same_sample) {
+        shape[0] = std::max(shape[0], planned_shape[0]);
+    }
+
+    // Steps: forward of layer i runs at i, backward of layer i at 2L - 1 - i, the loss in between.
+    // An output is read by the next layer's forward and, in training, kept as its input until
+    // that layer's backward. A gradient is read by the backward of the layer below it
+    const int L = static_cast<int>(layers.size());
+    std::vector<MemoryPlan::Buffer> buffers;
+    std::vector<int> output_owner(L + 1, -1);    // Buffer holding activation i, -1 for the network input
+    std::vector<int> gradient_owner(L + 1, -1);  // Buffer holding the gradient wrt activation i, -1 for the loss's
+    auto add = [&buffers](long size, int first_use, int last_use) {
+        MemoryPlan::Buffer buffer;
+        buffer.size = size;
+        buffer.first_use = first_use;
+        buffer.last_use = last_use;
+        buffers.push_back(buffer);
+        return static_cast<int>(buffers.size()) - 1;
+    };
+    // Views stretch the lifetime of whatever they look into
+    auto extend = [&buffers](int owner, int last_use) {
+        if (owner >= 0) {
+            buffers[owner].last_use = std::max(buffers[owner].last_use, last_use);
+        }
+    };
+
+    std::vector<Tensor::Shape> shapes(L + 1);
+    shapes[0] = shape;
+    for (int i = 0; i < L; ++i) {
+        shapes[i + 1] = layers[i]->output_shape(shapes[i]);
+        int last_use = training ? std::max(2 * L - 2 - i, i + 1) : i + 1;
+        if (layers[i]->returns_views()) {
+            output_owner[i + 1] = output_owner[i];
+            extend(output_owner[i + 1], last_use);
+        } else {
+            output_owner[i + 1] = add(element_count(shapes[i + 1]), i, last_use);
+        }
+    }
+    std::vector<int> own_output(L, -1), own_gradient(L, -1);
+    for (int i = 0; i < L; ++i) {
+        own_output[i] = layers[i]->returns_views() ? -1 : output_owner[i + 1];
+    }
+    if (training) {
+        for (int i = L - 1; i >= 0; --i) {
+            int step = 2 * L - 1 - i;
+            if (layers[i]->returns_views()) {
+                gradient_owner[i] = gradient_owner[i + 1];
+                extend(gradient_owner[i], step + 1);
+            } else {
+                gradient_owner[i] = own_gradient[i] = add(element_count(shapes[i]), step, step + 1);
+            }
+        }
+    }
+
+    const long alignment = std::max<long>(1, 64 / static_cast<long>(sizeof(Scalar)));
+    long arena_size = MemoryPlan::assign_offsets(buffers, alignment);
+    if (arena.size() < arena_size) {
+        arena = Tensor(1, 1, 1, arena_size);
+    }
+    auto view = [this, &buffers](int owner) {
+        return owner < 0 ? Tensor() : arena.view(buffers[owner].offset, {1, 1, 1, (int)buffers[owner].size});
+    };
+    for (int i = 0; i < L; ++i) {
+        layers[i]->bind_buffers(view(own_output[i]), view(own_gradient[i]));
+    }
+
+    planned_shape = shape;
+    planned_training = training;
+    memory_planned = true;
+}
+
+Tensor Network::predict(const Tensor& input) {
+    plan_memory(input.shape());
+    Tensor output = input;
     
     if (debug){
         // Print input dimensions
@@ -21,7 +161,7 @@ std::vector<Eigen::MatrixXd> Network::predict(const std::vector<Eigen::MatrixXd>
     }
     
     for (size_t i = 0; i < layers.size(); ++i) {
-        output = layers[i]->forward(output);
+        output = forward_layer(i, output);
         
         if (debug){
             // Print output dimensions after each layer
@@ -32,33 +172,652 @@ std::vector<Eigen::MatrixXd> Network::predict(const std::vector<Eigen::MatrixXd>
     return output;
 }
 
-void Network::train(const std::vector<std::vector<Eigen::MatrixXd>>& x_train,
-                   const std::vector<std::vector<Eigen::MatrixXd>>& y_train,
-                   std::function<double(const std::vector<Eigen::MatrixXd>&, const std::vector<Eigen::MatrixXd>&)> loss,
-                   std::function<std::vector<Eigen::MatrixXd>(const std::vector<Eigen::MatrixXd>&, const std::vector<Eigen::MatrixXd>&)> loss_prime,
+Tensor Network::forward_layer(size_t i, const Tensor& input) {
+    if (!profiling) {
+        return layers[i]->forward(input);
+    }
+    LayerProfile& layer = stats.layers[i];
+    long long bytes_before = Tensor::allocated_bytes();
+    Clock::time_point start = Clock::now();
+    Tensor output = layers[i]->forward(input);
+    layer.forward_seconds += seconds_since(start);
+    layer.bytes_allocated += Tensor::allocated_bytes() - bytes_before;
+    layer.forward_calls++;
+    layer.samples += input.batch();
+    return output;
+}
+
+Tensor Network::backward_layer(size_t i, const Tensor& output_gradient) {
+    if (!profiling) {
+        return layers[i]->backward(output_gradient);
+    }
+    LayerProfile& layer = stats.layers[i];
+    long long bytes_before = Tensor::allocated_bytes();
+    Clock::time_point start = Clock::now();
+    Tensor input_gradient = layers[i]->backward(output_gradient);
+    layer.backward_seconds += seconds_since(start);
+    layer.bytes_allocated += Tensor::allocated_bytes() - bytes_before;
+    layer.backward_calls++;
+    return input_gradient;
+}
+
+void Network::set_profiling(bool enabled) {
+    profiling = enabled;
+    if (enabled && stats.layers.size() != layers.size()) {
+        reset_profile();
+    }
+}
+
+void Network::reset_profile() {
+    stats = Profile();
+    for (size_t i = 0; i < layers.size(); ++i) {
+        LayerProfile layer;
+        layer.name = std::to_string(i) + ": " + layers[i]->name();
+        stats.layers.push_back(layer);
+    }
+}
+
+void Network::print_profile(std::ostream& out) const {
+    std::vector<const LayerProfile*> sorted;
+    double total = 0;
+    for (const auto& layer : stats.layers) {
+        sorted.push_back(&layer);
+        total += layer.total_seconds();
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const LayerProfile* a, const LayerProfile* b) {
+        return a->total_seconds() > b->total_seconds();
+    });
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "Profile: " << stats.samples << " samples in " << stats.batches << " batches, "
+        << std::fixed << std::setprecision(3) << stats.seconds << " s ("
+        << std::setprecision(1) << stats.samples_per_second() << " samples/s), "
+        << std::setprecision(2) << stats.update_seconds * 1e3 << " ms in " << optimizer->name() << " steps" << std::endl;
+    out << std::left << std::setw(24) << "  layer" << std::right
+        << std::setw(12) << "forward ms" << std::setw(13) << "backward ms" << std::setw(8) << "calls"
+        << std::setw(12) << "alloc MB" << std::setw(14) << "samples/s" << std::setw(8) << "time %" << std::endl;
+    for (const LayerProfile* layer : sorted) {
+        out << "  " << std::left << std::setw(22) << layer->name << std::right << std::setprecision(2)
+            << std::setw(12) << layer->forward_seconds * 1e3
+            << std::setw(13) << layer->backward_seconds * 1e3
+            << std::setw(8) << layer->forward_calls
+            << std::setw(12) << layer->bytes_allocated / (1024.0 * 1024.0)
+            << std::setprecision(1) << std::setw(14) << layer->samples_per_second()
+            << std::setw(8) << (total > 0 ? 100 * layer->total_seconds() / total : 0) << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void Network::set_optimizer(std::shared_ptr<Optimizer> optimizer) {
+    if (!optimizer) {
+        throw std::invalid_argument("Network::set_optimizer: null optimizer");
+    }
+    this->optimizer = std::move(optimizer);
+}
+
+void Network::pack_parameters() {
+    // Steady state: every tensor still where the last packing put it
+    bool in_place = packing_valid;
+    for (const PackedSlot& slot : packed_slots) {
+        in_place = in_place && slot.parameter->data() == packed_parameters.data() + slot.offset &&
+                   slot.gradient->data() == packed_gradients.data() + slot.offset &&
+                   slot.parameter->size() == slot.size && slot.gradient->size() == slot.size;
+    }
+    if (in_place) {
+        return;
+    }
+
+    if (!packing_valid) {
+        packed_slots.clear();
+        for (auto& layer : layers) {
+            std::vector<Tensor*> parameters = layer->parameters();
+            std::vector<Tensor*> gradients = layer->gradients();
+            if (parameters.size() != gradients.size()) {
+                throw std::logic_error(layer->name() + " has " + std::to_string(parameters.size()) + " parameters but " +
+                                       std::to_string(gradients.size()) + " gradients");
+            }
+            for (size_t k = 0; k < parameters.size(); ++k) {
+                if (!parameters[k]->same_shape(*gradients[k])) {
+                    throw std::logic_error(layer->name() + ": a parameter and its gradient differ in shape");
+                }
+                packed_slots.push_back({parameters[k], gradients[k], 0, 0});
+            }
+        }
+    }
+
+    const long alignment = Tensor::alignment / sizeof(Scalar);
+    long total = 0;
+    for (PackedSlot& slot : packed_slots) {
+        slot.offset = total;
+        slot.size = slot.parameter->size();
+        total += (slot.size + alignment - 1) / alignment * alignment;
+    }
+    Tensor new_parameters(1, 1, 1, static_cast<int>(total));
+    Tensor new_gradients(1, 1, 1, static_cast<int>(total));
+    for (PackedSlot& slot : packed_slots) {
+        Tensor parameter = new_parameters.view(slot.offset, slot.parameter->shape());
+        Tensor gradient = new_gradients.view(slot.offset, slot.gradient->shape());
+        parameter.flat() = slot.parameter->flat();
+        gradient.flat() = slot.gradient->flat();
+        *slot.parameter = parameter;
+        *slot.gradient = gradient;
+    }
+    packed_parameters = new_parameters;
+    packed_gradients = new_gradients;
+    packing_valid = true;
+}
+
+void Network::zero_gradients() {
+    pack_parameters();
+    packed_gradients.set_zero();
+}
+
+void Network::step(double learning_rate) {
+    Clock::time_point start = Clock::now();
+    pack_parameters();
+    optimizer->learning_rate = learning_rate;
+    optimizer->step(packed_parameters, packed_gradients);
+    // Drops whatever the layers (and the replicas reading the same parameters) derived from the old ones
+    for (auto& layer : layers) {
+        layer->parameters_changed();
+    }
+    for (auto& replica : replicas) {
+        for (auto& layer : replica->layers) {
+            layer->parameters_changed();
+        }
+    }
+    if (profiling) {
+        double seconds = seconds_since(start);
+        stats.update_seconds += seconds;
+        stats.seconds += seconds;
+    }
+}
+
+void Network::save(const std::string& path) const {
+    Checkpoint::save(checkpoint_layers(), path);
+}
+
+void Network::load(const std::string& path) {
+    Checkpoint::load(checkpoint_layers(), path);
+}
+
+std::vector<std::shared_ptr<Layer>> Network::checkpoint_layers() const {
+    std::vector<std::shared_ptr<Layer>> expanded;
+    for (const auto& layer : layers) {
+        auto block = std::dynamic_pointer_cast<FusedConvReLUPool>(layer);
+        if (!block) {
+            expanded.push_back(layer);
+            continue;
+        }
+        // The block's parameters are the convolution's; ReLU and pooling only contribute their names
+        expanded.push_back(block->convolution());
+        expanded.push_back(std::make_shared<ReLU>());
+        expanded.push_back(std::make_shared<MaxPooling>(block->pooling_size(), block->pooling_stride()));
+    }
+    return expanded;
+}
+
+int Network::fuse() {
+    std::vector<std::shared_ptr<Layer>> fused;
+    int blocks = 0;
+    for (size_t i = 0; i < layers.size(); ++i) {
+        auto conv = std::dynamic_pointer_cast<Convolutional>(layers[i]);
+        if (conv && i + 2 < layers.size() && std::dynamic_pointer_cast<ReLU>(layers[i + 1])) {
+            if (auto pool = std::dynamic_pointer_cast<MaxPooling>(layers[i + 2])) {
+                auto block = std::make_shared<FusedConvReLUPool>(conv, pool->pool_size(), pool->pool_stride());
+                block->set_training(training);
+                fused.push_back(block);
+                i += 2;
+                blocks++;
+                continue;
+            }
+        }
+        fused.push_back(layers[i]);
+    }
+    layers = fused;
+    memory_planned = false;
+    packing_valid = false;
+    replicas.clear();
+    stage_begin.clear();
+    if (profiling) {
+        reset_profile();
+    }
+    return blocks;
+}
+
+void Network::set_training(bool training) {
+    this->training = training;
+    memory_planned = false;
+    for (auto& layer : layers) {
+        layer->set_training(training);
+    }
+}
+
+Network::InferenceMode::InferenceMode(Network& network) : network(network), was_training(network.is_training()) {
+    network.set_training(false);
+}
+
+Network::InferenceMode::~InferenceMode() {
+    network.set_training(was_training);
+}
+
+double Network::train_batch(const Tensor& x_batch,
+                            const Tensor& y_batch,
+                            LossFunction loss,
+                            LossPrimeFunction loss_prime,
+                            double learning_rate) {
+    zero_gradients();
+    double error = accumulate_gradients(x_batch, y_batch, loss, loss_prime);
+    step(learning_rate);
+    return error;
+}
+
+void Network::set_data_parallel(int num_workers) {
+    parallel_workers = num_workers > 0 ? num_workers : ThreadPool::global().num_threads();
+    if (static_cast<int>(replicas.size()) >= parallel_workers) {
+        replicas.resize(parallel_workers - 1);
+    }
+}
+
+double Network::accumulate_gradients(const Tensor& x_batch,
+                                     const Tensor& y_batch,
+                                     LossFunction loss,
+                                     LossPrimeFunction loss_prime,
+                                     double gradient_scale) {
+    if (!training) {
+        throw std::logic_error("Network: training called in inference mode");
+    }
+    Clock::time_point start = Clock::now();
+    // Stage threads started from a pool worker would run inline, one after another, and deadlock
+    int stages = ThreadPool::on_worker_thread() ? 1 : std::min(pipeline_stages, static_cast<int>(layers.size()));
+    int workers = std::min(parallel_workers, x_batch.batch());
+    double error;
+    if (stages > 1) {
+        error = run_pipeline(stages, x_batch, y_batch, loss, loss_prime, gradient_scale);
+    } else if (workers > 1) {
+        error = run_data_parallel(workers, x_batch, y_batch, loss, loss_prime, gradient_scale);
+    } else {
+        error = run_batch(x_batch, y_batch, loss, loss_prime, gradient_scale);
+    }
+    if (profiling) {
+        stats.batches++;
+        stats.samples += x_batch.batch();
+        stats.seconds += seconds_since(start);
+    }
+    return error;
+}
+
+double Network::run_batch(const Tensor& x_batch,
+                          const Tensor& y_batch,
+                          LossFunction loss,
+                          LossPrimeFunction loss_prime,
+                          double gradient_scale) {
+    // Forward pass
+    Tensor output = predict(x_batch);
+
+    // Calculate error
+    double error = loss(y_batch, output);
+
+    // Backward pass, every layer adds to its gradients
+    Tensor grad = loss_prime(y_batch, output);
+    if (gradient_scale != 1) {
+        grad.flat() *= Scalar(gradient_scale);
+    }
+    for (size_t i = layers.size(); i-- > 0;) {
+        grad = backward_layer(i, grad);
+    }
+    return error;
+}
+
+double Network::run_data_parallel(int workers,
+                                  const Tensor& x_batch,
+                                  const Tensor& y_batch,
+                                  LossFunction loss,
+                                  LossPrimeFunction loss_prime,
+                                  double gradient_scale) {
+    prepare_replicas(workers - 1);
+    const int batch = x_batch.batch();
+    std::vector<double> errors(workers);
+    // Shards on pool threads run their layers' loops inline. Shard 0 stays on the calling thread,
+    // whose layers still issue parallel_for jobs: those are picked up by workers done with their
+    // shard, and the caller works through its own job meanwhile, so it never waits on a busy pool
+    ThreadPool::global().parallel_for(0, workers, [&](int w) {
+        int first = static_cast<int>((long)batch * w / workers);
+        int count = static_cast<int>((long)batch * (w + 1) / workers) - first;
+        // Each shard's loss is a mean over the shard, weighted here into a mean over the batch
+        double share = double(count) / batch;
+        Network& worker = w == 0 ? *this : *replicas[w - 1];
+        if (w > 0) {
+            worker.packed_gradients.set_zero();
+        }
+        errors[w] = share * worker.run_batch(x_batch.slice(first, count), y_batch.slice(first, count), loss, loss_prime,
+                                             gradient_scale * share);
+    });
+    reduce_gradients(workers - 1);
+
+    double error = 0;
+    for (double e : errors) {
+        error += e;
+    }
+    return error;
+}
+
+void Network::set_pipeline(int num_stages, int micro_batches) {
+    pipeline_stages = num_stages > 0 ? num_stages : ThreadPool::global().num_threads();
+    pipeline_micro_batches = std::max(0, micro_batches);
+    stage_begin.clear();
+    stage_threads.reset();
+}
+
+double Network::run_pipeline(int stages,
+                             const Tensor& x_batch,
+                             const Tensor& y_batch,
+                             LossFunction loss,
+                             LossPrimeFunction loss_prime,
+                             double gradient_scale) {
+    const int batch = x_batch.batch();
+    const int micro = std::min(batch, pipeline_micro_batches > 0 ? pipeline_micro_batches : 4 * stages);
+    auto first = [&](int m) { return static_cast<int>((long)batch * m / micro); };
+    prepare_replicas(stages - 1);
+    if (static_cast<int>(stage_begin.size()) != stages + 1) {
+        balance_pipeline(stages, x_batch.slice(0, first(1)), y_batch.slice(0, first(1)), loss, loss_prime);
+    }
+    for (int r = 0; r < stages - 1; ++r) {
+        replicas[r]->packed_gradients.set_zero();
+    }
+
+    // Micro-batch m runs on worker m % stages. Stage s never has more than stages - s micro-batches
+    // between their forward and backward, so m + stages only starts once m is done everywhere
+    auto worker_of = [&](int m) -> Network& { return m % stages == 0 ? *this : *replicas[m % stages - 1]; };
+    // Stage s's input activation and output gradient for micro-batch m, at s * micro + m
+    std::vector<Tensor> activations(stages * micro), gradients(stages * micro);
+    std::vector<char> activation_ready(stages * micro, 0), gradient_ready(stages * micro, 0);
+    std::vector<double> errors(micro);
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool failed = false;
+
+    auto put = [&](std::vector<Tensor>& slots, std::vector<char>& flags, int index, const Tensor& value) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[index] = value;
+            flags[index] = 1;
+        }
+        ready.notify_all();
+    };
+    // False once another stage has failed, so this one stops instead of waiting forever
+    auto take = [&](std::vector<Tensor>& slots, std::vector<char>& flags, int index, Tensor& value) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [&] { return flags[index] || failed; });
+        value = slots[index];
+        slots[index] = Tensor();
+        return !failed;
+    };
+
+    auto forward = [&](int s, int m) {
+        Network& worker = worker_of(m);
+        int count = first(m + 1) - first(m);
+        Tensor value;
+        if (s == 0) {
+            value = x_batch.slice(first(m), count);
+            worker.plan_memory(value.shape());
+        } else if (!take(activations, activation_ready, s * micro + m, value)) {
+            return false;
+        }
+        for (int i = stage_begin[s]; i < stage_begin[s + 1]; ++i) {
+            value = worker.forward_layer(i, value);
+        }
+        if (s + 1 < stages) {
+            put(activations, activation_ready, (s + 1) * micro + m, value);
+            return true;
+        }
+        // Each micro-batch's loss is a mean over it, weighted here into a mean over the batch
+        Tensor target = y_batch.slice(first(m), count);
+        double share = double(count) / batch;
+        errors[m] = share * loss(target, value);
+        Tensor grad = loss_prime(target, value);
+        grad.flat() *= Scalar(gradient_scale * share);
+        put(gradients, gradient_ready, s * micro + m, grad);
+        return true;
+    };
+    auto backward = [&](int s, int m) {
+        Network& worker = worker_of(m);
+        Tensor grad;
+        if (!take(gradients, gradient_ready, s * micro + m, grad)) {
+            return false;
+        }
+        for (int i = stage_begin[s + 1]; i-- > stage_begin[s];) {
+            grad = worker.backward_layer(i, grad);
+        }
+        if (s > 0) {
+            put(gradients, gradient_ready, (s - 1) * micro + m, grad);
+        }
+        return true;
+    };
+
+    // Stages wait on each other, so each needs a thread of its own for the whole batch. Nothing else
+    // runs on stage_threads, and no stage finishes before all have started, so every thread claims
+    // exactly one. Their layers find themselves on pool workers and run their loops inline
+    if (!stage_threads || stage_threads->num_threads() != stages) {
+        stage_threads = std::make_unique<ThreadPool>(stages);
+    }
+    stage_threads->parallel_for(0, stages, [&](int s) {
+        try {
+            // Fill the pipeline, then alternate one forward and one backward, then drain it
+            int warmup = std::min(stages - s - 1, micro);
+            int forwards = 0, backwards = 0;
+            bool running = true;
+            while (running && forwards < warmup) {
+                running = forward(s, forwards++);
+            }
+            while (running && backwards < micro) {
+                if (forwards < micro) {
+                    running = forward(s, forwards++);
+                }
+                running = running && backward(s, backwards++);
+            }
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                failed = true;
+            }
+            ready.notify_all();
+            throw;
+        }
+    });
+    reduce_gradients(stages - 1);
+
+    double error = 0;
+    for (double e : errors) {
+        error += e;
+    }
+    return error;
+}
+
+void Network::balance_pipeline(int stages,
+                               const Tensor& x_batch,
+                               const Tensor& y_batch,
+                               LossFunction loss,
+                               LossPrimeFunction loss_prime) {
+    // Timed on a replica, whose gradients run_pipeline clears anyway. The first pass plans memory
+    // and builds the layers' caches, the second is the one measured
+    Network& probe = *replicas[0];
+    probe.set_profiling(true);
+    for (int pass = 0; pass < 2; ++pass) {
+        probe.reset_profile();
+        probe.run_batch(x_batch, y_batch, loss, loss_prime, 1);
+    }
+    std::vector<double> cost;
+    for (const auto& layer : probe.stats.layers) {
+        cost.push_back(layer.total_seconds());
+    }
+    probe.set_profiling(false);
+    stage_begin = balanced_partition(cost, stages);
+}
+
+double Network::train_hogwild(int num_batches,
+                              const std::function<std::pair<Tensor, Tensor>(int)>& get_batch,
+                              LossFunction loss,
+                              LossPrimeFunction loss_prime,
+                              double learning_rate,
+                              int num_workers) {
+    if (!training) {
+        throw std::logic_error("Network: training called in inference mode");
+    }
+    Clock::time_point start = Clock::now();
+    int workers = num_workers > 0 ? num_workers : ThreadPool::global().num_threads();
+    workers = std::max(1, std::min(workers, num_batches));
+    prepare_replicas(workers - 1);
+
+    const long size = packed_parameters.size();
+    // Packed slots start on cache lines, so a line never holds two slots' elements
+    const long line = Tensor::alignment / sizeof(Scalar);
+    const Scalar rate = Scalar(learning_rate);
+    std::atomic<int> next_batch{0};
+    std::vector<double> errors(workers);
+    std::vector<long> samples(workers);
+    ThreadPool::global().parallel_for(0, workers, [&](int w) {
+        Network& worker = w == 0 ? *this : *replicas[w - 1];
+        Scalar* parameters = packed_parameters.data();
+        const Scalar* gradients = worker.packed_gradients.data();
+        for (int b = next_batch++; b < num_batches; b = next_batch++) {
+            std::pair<Tensor, Tensor> batch = get_batch(b);
+            worker.packed_gradients.set_zero();
+            errors[w] += worker.run_batch(batch.first, batch.second, loss, loss_prime, 1) * batch.first.batch();
+            samples[w] += batch.first.batch();
+            // Unsynchronized on purpose: other workers may be reading or updating the same parameters
+            for (long begin = 0; begin < size; begin += line) {
+                long count = std::min(line, size - begin);
+                Eigen::Map<const ArrayXs> g(gradients + begin, count);
+                if ((g != 0).any()) {
+                    Eigen::Map<ArrayXs>(parameters + begin, count) -= rate * g;
+                }
+            }
+            // Whatever this worker's layers derived from the parameters is stale now
+            for (auto& layer : worker.layers) {
+                layer->parameters_changed();
+            }
+        }
+    });
+
+    double error = 0;
+    long total = 0;
+    for (int w = 0; w < workers; ++w) {
+        error += errors[w];
+        total += samples[w];
+    }
+    if (profiling) {
+        stats.batches += num_batches;
+        stats.samples += total;
+        stats.seconds += seconds_since(start);
+    }
+    return total > 0 ? error / total : 0;
+}
+
+void Network::prepare_replicas(int count) {
+    pack_parameters();
+    while (static_cast<int>(replicas.size()) < count) {
+        std::vector<std::shared_ptr<Layer>> copies;
+        for (const auto& layer : layers) {
+            copies.push_back(layer->clone());
+        }
+        replicas.push_back(std::make_shared<Network>(copies));
+        share_parameters(*replicas.back());
+    }
+    // Repacking (after load, say) moves the parameters, so follow them
+    for (int r = 0; r < count; ++r) {
+        if (replicas[r]->packed_parameters.data() != packed_parameters.data()) {
+            share_parameters(*replicas[r]);
+        }
+    }
+}
+
+void Network::share_parameters(Network& replica) const {
+    replica.packed_parameters = packed_parameters;
+    replica.packed_gradients = Tensor(packed_gradients.shape());
+    replica.packed_slots.clear();
+    for (auto& layer : replica.layers) {
+        std::vector<Tensor*> parameters = layer->parameters();
+        std::vector<Tensor*> gradients = layer->gradients();
+        for (size_t k = 0; k < parameters.size(); ++k) {
+            size_t slot_index = replica.packed_slots.size();
+            if (slot_index >= packed_slots.size() || !parameters[k]->same_shape(*packed_slots[slot_index].parameter)) {
+                throw std::logic_error("Network: replica layers do not match the original's");
+            }
+            const PackedSlot& slot = packed_slots[slot_index];
+            *parameters[k] = packed_parameters.view(slot.offset, parameters[k]->shape());
+            *gradients[k] = replica.packed_gradients.view(slot.offset, gradients[k]->shape());
+            replica.packed_slots.push_back({parameters[k], gradients[k], slot.offset, slot.size});
+        }
+        layer->parameters_changed();
+    }
+    if (replica.packed_slots.size() != packed_slots.size()) {
+        throw std::logic_error("Network: replica layers do not match the original's");
+    }
+    replica.packing_valid = true;
+}
+
+void Network::reduce_gradients(int count) {
+    // Pairwise tree: at distance d, worker i (a multiple of 2d) takes in worker i + d. The additions
+    // are always the same ones in the same order, so the sum only depends on the worker count
+    const long size = packed_gradients.size();
+    const long chunk = 1 << 14;
+    const int chunks = static_cast<int>((size + chunk - 1) / chunk);
+    auto gradients_of = [this](int worker) -> Tensor& {
+        return worker == 0 ? packed_gradients : replicas[worker - 1]->packed_gradients;
+    };
+    for (int distance = 1; distance <= count; distance *= 2) {
+        int pairs = (count + 1 + 2 * distance - 1) / (2 * distance);
+        ThreadPool::global().parallel_for(0, pairs * chunks, [&](int task) {
+            int target = task / chunks * 2 * distance;
+            int source = target + distance;
+            if (source > count) {
+                return;
+            }
+            long begin = task % chunks * chunk;
+            long length = std::min(chunk, size - begin);
+            gradients_of(target).flat().segment(begin, length) += gradients_of(source).flat().segment(begin, length);
+        });
+    }
+}
+
+void Network::train(const Tensor& x_train,
+                   const Tensor& y_train,
+                   LossFunction loss,
+                   LossPrimeFunction loss_prime,
                    int epochs,
                    double learning_rate,
-                   bool verbose) {
+                   bool verbose,
+                   int batch_size,
+                   int accumulation_steps) {
+    int num_samples = x_train.batch();
+    batch_size = std::max(1, std::min(batch_size, num_samples));
+    long update_size = (long)batch_size * std::max(1, accumulation_steps);
+
     for (int e = 0; e < epochs; e++) {
         double error = 0;
         
-        for (size_t i = 0; i < x_train.size(); i++) {
-            // Forward pass
-            std::vector<Eigen::MatrixXd> output = predict(x_train[i]);
-            
-            // Calculate error
-            error += loss(y_train[i], output);
-            
-            // Backward pass
-            std::vector<Eigen::MatrixXd> grad = loss_prime(y_train[i], output);
-            for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
-                grad = (*it)->backward(grad, learning_rate);
+        for (int first = 0; first < num_samples; first += update_size) {
+            int group = static_cast<int>(std::min<long>(update_size, num_samples - first));
+            zero_gradients();
+            for (int start = first; start < first + group; start += batch_size) {
+                int count = std::min(batch_size, first + group - start);
+                // Weight the batch mean by its size so the epoch error stays a per-sample mean
+                error += count * accumulate_gradients(x_train.slice(start, count), y_train.slice(start, count),
+                                                      loss, loss_prime, double(count) / group);
             }
+            step(learning_rate);
         }
         
-        error /= x_train.size();
+        error /= num_samples;
         if (verbose) {
             std::cout << e + 1 << "/" << epochs << ", error=" << error << std::endl;
         }
     }
-} 
\ No newline at end of file
+
+    if (profiling) {
+        print_profile();
+    }
+}
\ No newline at end of file
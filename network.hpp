@@ -1,25 +1,244 @@
 #pragma once
 #include "layer.hpp"
 #include "losses.hpp"
+#include "optimizer.hpp"
+#include "thread_pool.hpp"
 #include <vector>
 #include <memory>
 #include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
 
 class Network {
 public:
     Network(const std::vector<std::shared_ptr<Layer>>& layers);
     Network(const std::vector<std::shared_ptr<Layer>>& layers, bool debug);
-    
-    std::vector<Eigen::MatrixXd> predict(const std::vector<Eigen::MatrixXd>& input);
-    void train(const std::vector<std::vector<Eigen::MatrixXd>>& x_train, 
-               const std::vector<std::vector<Eigen::MatrixXd>>& y_train,
-               std::function<double(const std::vector<Eigen::MatrixXd>&, const std::vector<Eigen::MatrixXd>&)> loss,
-               std::function<std::vector<Eigen::MatrixXd>(const std::vector<Eigen::MatrixXd>&, const std::vector<Eigen::MatrixXd>&)> loss_prime,
+
+    using LossFunction = std::function<double(const Tensor&, const Tensor&)>;
+    using LossPrimeFunction = std::function<Tensor(const Tensor&, const Tensor&)>;
+
+    // The result lives in the network's activation arena and is only valid until the next
+    // predict or train call; clone() it to keep it longer
+    Tensor predict(const Tensor& input);
+    // x_train and y_train hold one sample per batch entry. Each epoch walks them in
+    // mini-batches of batch_size samples with one forward and backward per mini-batch, and one
+    // update per accumulation_steps mini-batches (their gradients summed, as for one batch of them all).
+    // learning_rate is handed to the optimizer, see set_optimizer()
+    void train(const Tensor& x_train,
+               const Tensor& y_train,
+               LossFunction loss,
+               LossPrimeFunction loss_prime,
                int epochs = 1000,
                double learning_rate = 0.01,
-               bool verbose = true);
+               bool verbose = true,
+               int batch_size = 1,
+               int accumulation_steps = 1);
+    // One forward, backward and optimizer step over the whole batch, returns the batch loss.
+    // Same as zero_gradients(), accumulate_gradients() and step()
+    double train_batch(const Tensor& x_batch,
+                       const Tensor& y_batch,
+                       LossFunction loss,
+                       LossPrimeFunction loss_prime,
+                       double learning_rate);
+
+    // Gradient accumulation, for effective batches larger than fit in memory at once:
+    //   zero_gradients();
+    //   accumulate_gradients(...) once per micro-batch;
+    //   step(learning_rate);
+    // Backward adds into the layers' gradient buffers, so the micro-batches' gradients sum up.
+    // Losses average over their batch, so pass gradient_scale = micro-batch size / effective
+    // batch size to get the gradient of the mean loss over the whole effective batch
+    void zero_gradients();
+    // Forward and backward of one micro-batch, returns its loss
+    double accumulate_gradients(const Tensor& x_batch,
+                                const Tensor& y_batch,
+                                LossFunction loss,
+                                LossPrimeFunction loss_prime,
+                                double gradient_scale = 1);
+    // One optimizer step with the gradients accumulated since zero_gradients()
+    void step(double learning_rate);
+
+    // Data parallelism: accumulate_gradients (and so train_batch and train) splits every batch
+    // into num_workers contiguous shards and runs them at once on ThreadPool::global(), each on
+    // its own replica of the layers (see Layer::clone). Replicas read this network's parameters
+    // in place and keep their own activations and gradients, which are summed into this
+    // network's by a pairwise tree before the step. The result depends on num_workers, but is the
+    // same on every run for a given value. 0 uses one worker per pool thread, 1 turns it off
+    void set_data_parallel(int num_workers);
+    int data_parallel_workers() const { return parallel_workers; }
+
+    // Pipeline parallelism: accumulate_gradients splits every batch into micro_batches pieces
+    // (0: four per stage) and streams them through num_stages contiguous runs of layers (0: one per
+    // ThreadPool::global() thread), in the one-forward-one-backward order of PipeDream-Flush. Every
+    // stage runs on a thread of its own, kept by the network (the caller runs the first stage), so
+    // other users of the global pool can never hold up the pipeline. A micro-batch lives on one
+    // replica of the layers, as in data parallelism, so at most num_stages of them are in flight.
+    // Stage boundaries are balanced on the measured forward and backward time of every layer at the
+    // first pipelined batch, and again after fuse() or set_pipeline(). Results only depend on
+    // num_stages and micro_batches. Stages are capped by the layer count. Takes precedence over
+    // set_data_parallel; 1 stage turns it off. Inside a pool task the batch runs serially instead
+    void set_pipeline(int num_stages, int micro_batches = 0);
+    int pipeline_stage_count() const { return pipeline_stages; }
+    // First layer of every stage, then the layer count. Empty until the stages are balanced
+    const std::vector<int>& pipeline_partition() const { return stage_begin; }
+
+    // One epoch of Hogwild (Niu et al., 2011): num_workers threads (0: one per pool thread) each take
+    // the next unclaimed of batches 0 .. num_batches - 1 from get_batch, run forward and backward on
+    // their own replica and apply a plain SGD step straight to the shared parameters. There are no
+    // locks or barriers between workers: their reads and writes of the parameters race, and a step
+    // only writes the cache lines its gradient is non-zero in, so sparse gradients rarely collide.
+    // The optimizer set on the network is not used, and the result differs from run to run.
+    // get_batch is called from several threads at once (DataLoader::get_batch is safe to).
+    // Returns the mean loss over the epoch
+    double train_hogwild(int num_batches,
+                         const std::function<std::pair<Tensor, Tensor>(int)>& get_batch,
+                         LossFunction loss,
+                         LossPrimeFunction loss_prime,
+                         double learning_rate,
+                         int num_workers = 0);
     bool debug;
 
+    // Switches every layer between training and inference mode, see Layer::set_training().
+    // predict() in inference mode keeps no activations around for backward, and its plan
+    // lets every activation reuse memory as soon as the next layer has consumed it.
+    // Networks sharing layers each bind them to their own arena, so switch modes (or
+    // fuse) before handing the layers back and forth between them
+    void set_training(bool training);
+    bool is_training() const { return training; }
+
+    // Rule for every parameter update, plain SGD unless set. The optimizer keeps its state
+    // (momentum, moment estimates) across train calls; its learning rate is set by each one
+    void set_optimizer(std::shared_ptr<Optimizer> optimizer);
+    const std::shared_ptr<Optimizer>& get_optimizer() const { return optimizer; }
+
+    // The layers in order, fused ones included
+    const std::vector<std::shared_ptr<Layer>>& get_layers() const { return layers; }
+
+    // Writes every layer's parameters to a binary checkpoint, see checkpoint.hpp. Fused blocks are
+    // written as the Convolutional, ReLU and MaxPooling they replaced, so the file loads into the
+    // network whether or not either side called fuse()
+    void save(const std::string& path) const;
+    // Points every layer's parameters at a checkpoint saved from a network with the same layers.
+    // The file is memory-mapped and used in place, nothing is copied
+    void load(const std::string& path);
+
+    // Replaces every Convolutional -> ReLU -> MaxPooling run with one FusedConvReLUPool
+    // sharing the convolution's parameters. Returns the number of blocks fused
+    int fuse();
+
+    // Counters for one layer, collected while profiling is on
+    struct LayerProfile {
+        std::string name;               // "<position>: <layer type>"
+        long forward_calls = 0;
+        long backward_calls = 0;
+        double forward_seconds = 0;
+        double backward_seconds = 0;
+        long long bytes_allocated = 0;  // Tensor storage allocated inside forward and backward
+        long samples = 0;               // Samples passed through forward
+
+        double total_seconds() const { return forward_seconds + backward_seconds; }
+        double samples_per_second() const { return total_seconds() > 0 ? samples / total_seconds() : 0; }
+    };
+    struct Profile {
+        std::vector<LayerProfile> layers;  // In network order
+        long batches = 0;                  // Batches (or micro-batches) trained on
+        long samples = 0;                  // Samples trained on
+        double seconds = 0;                // Wall time spent training, optimizer steps included
+        double update_seconds = 0;         // Part of it spent in optimizer steps
+
+        double samples_per_second() const { return seconds > 0 ? samples / seconds : 0; }
+    };
+
+    // Profiling times every layer call and counts its tensor allocations. Off by default,
+    // and costs one branch per layer call while off. train() prints a report at the end when on
+    void set_profiling(bool enabled);
+    bool is_profiling() const { return profiling; }
+    const Profile& profile() const { return stats; }
+    void reset_profile();
+    // Layers sorted by total time, slowest first
+    void print_profile(std::ostream& out = std::cout) const;
+
+    // Puts the network in inference mode for the guard's lifetime, then restores the previous mode
+    class InferenceMode {
+    public:
+        explicit InferenceMode(Network& network);
+        ~InferenceMode();
+        InferenceMode(const InferenceMode&) = delete;
+        InferenceMode& operator=(const InferenceMode&) = delete;
+
+    private:
+        Network& network;
+        bool was_training;
+    };
+
 private:
     std::vector<std::shared_ptr<Layer>> layers;
-}; 
\ No newline at end of file
+    bool training = true;
+    bool profiling = false;
+    Profile stats;
+    std::shared_ptr<Optimizer> optimizer;
+
+    // Every layer's parameters back to back, each starting on a Tensor::alignment boundary,
+    // and their gradients in the same layout. The layers' own tensors are views into these,
+    // so an optimizer step is one pass over two flat arrays
+    Tensor packed_parameters;
+    Tensor packed_gradients;
+    // Where each layer tensor sits in the packed storage, collected once per layer list
+    struct PackedSlot {
+        Tensor* parameter;
+        Tensor* gradient;
+        long offset;
+        long size;
+    };
+    std::vector<PackedSlot> packed_slots;
+    bool packing_valid = false;
+
+    // Workers 1 and up of data-parallel training, worker 0 being this network. Created on demand
+    int parallel_workers = 1;
+    std::vector<std::shared_ptr<Network>> replicas;
+
+    int pipeline_stages = 1;
+    int pipeline_micro_batches = 0;
+    std::vector<int> stage_begin;
+    // Threads of stages 1 and up: a pool of its own, so all stages always run at once
+    std::unique_ptr<ThreadPool> stage_threads;
+
+    // Forward and backward of one batch on this network's own layers
+    double run_batch(const Tensor& x_batch, const Tensor& y_batch, LossFunction loss, LossPrimeFunction loss_prime,
+                     double gradient_scale);
+    double run_data_parallel(int workers, const Tensor& x_batch, const Tensor& y_batch, LossFunction loss,
+                             LossPrimeFunction loss_prime, double gradient_scale);
+    double run_pipeline(int stages, const Tensor& x_batch, const Tensor& y_batch, LossFunction loss,
+                        LossPrimeFunction loss_prime, double gradient_scale);
+    // Times every layer on one batch and splits the layers into stages of about equal time
+    void balance_pipeline(int stages, const Tensor& x_batch, const Tensor& y_batch, LossFunction loss,
+                          LossPrimeFunction loss_prime);
+    // Makes count replicas, all pointing at the current packed parameters
+    void prepare_replicas(int count);
+    // Points replica's parameters at this network's packed storage, in the same layout, and gives it
+    // packed gradients of its own
+    void share_parameters(Network& replica) const;
+    // Adds the gradients of the first count replicas into this network's
+    void reduce_gradients(int count);
+
+    // Points every parameter and gradient into the packed tensors, repacking (and copying the
+    // values over) when a layer's tensors live elsewhere: first use, after fuse() or load()
+    void pack_parameters();
+
+    // Activation memory plan: every layer output and input gradient is a view into arena,
+    // placed by MemoryPlan from its lifetime over one forward and backward pass
+    Tensor arena;
+    Tensor::Shape planned_shape{};  // Input shape the plan was made for, batch being the capacity
+    bool planned_training = true;
+    bool memory_planned = false;
+
+    // The layers as checkpoints list them: every fused block expanded back into its three layers
+    std::vector<std::shared_ptr<Layer>> checkpoint_layers() const;
+
+    // Replans when the input no longer fits the current plan, otherwise a no-op
+    void plan_memory(const Tensor::Shape& input_shape);
+
+    Tensor forward_layer(size_t i, const Tensor& input);
+    Tensor backward_layer(size_t i, const Tensor& output_gradient);
+};
\ No newline at end of file
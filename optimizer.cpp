@@ -0,0 +1,103 @@
+#include "optimizer.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+    // Elements per task: large enough to amortise scheduling, small enough to spread a few million parameters
+    constexpr long chunk_size = 1 << 14;
+}
+
+void Optimizer::step(Tensor& parameters, const Tensor& gradients) {
+    if (parameters.size() != gradients.size()) {
+        throw std::invalid_argument("Optimizer::step: parameters and gradients differ in size");
+    }
+    const long size = parameters.size();
+    if (size != state_size) {
+        reset_state(size);
+        state_size = size;
+        step_count = 0;
+    }
+    step_count++;
+
+    Scalar* p = parameters.data();
+    const Scalar* g = gradients.data();
+    int chunks = static_cast<int>((size + chunk_size - 1) / chunk_size);
+    ThreadPool::global().parallel_for(0, chunks, [&](int chunk) {
+        long begin = chunk * chunk_size;
+        update(p, g, begin, std::min(chunk_size, size - begin));
+    });
+}
+
+void Optimizer::reset() {
+    state_size = -1;
+    step_count = 0;
+}
+
+SGD::SGD(double learning_rate, double momentum, bool nesterov, double weight_decay)
+    : Optimizer(learning_rate), momentum(Scalar(momentum)), nesterov(nesterov), weight_decay(Scalar(weight_decay)) {}
+
+void SGD::reset_state(long size) {
+    velocity = ArrayXs::Zero(momentum != 0 ? size : 0);
+}
+
+void SGD::update(Scalar* parameters, const Scalar* gradients, long begin, long count) {
+    Eigen::Map<ArrayXs> p(parameters + begin, count);
+    Eigen::Map<const ArrayXs> grad(gradients + begin, count);
+    const Scalar lr = Scalar(learning_rate);
+    auto g = grad + weight_decay * p;
+    if (momentum == 0) {
+        p -= lr * g;
+        return;
+    }
+    if (velocity.size() < begin + count) {
+        // Momentum was switched on after the first step
+        throw std::logic_error("SGD: momentum changed after stepping, call reset() first");
+    }
+    auto v = velocity.segment(begin, count);
+    v = momentum * v + g;
+    if (nesterov) {
+        p -= lr * (g + momentum * v);
+    } else {
+        p -= lr * v;
+    }
+}
+
+Adam::Adam(double learning_rate, double beta1, double beta2, double epsilon, double weight_decay)
+    : Optimizer(learning_rate), beta1(Scalar(beta1)), beta2(Scalar(beta2)), epsilon(Scalar(epsilon)),
+      weight_decay(Scalar(weight_decay)) {}
+
+void Adam::reset_state(long size) {
+    first_moment = ArrayXs::Zero(size);
+    second_moment = ArrayXs::Zero(size);
+}
+
+void Adam::update(Scalar* parameters, const Scalar* gradients, long begin, long count) {
+    Eigen::Map<ArrayXs> p(parameters + begin, count);
+    Eigen::Map<const ArrayXs> grad(gradients + begin, count);
+    auto m = first_moment.segment(begin, count);
+    auto v = second_moment.segment(begin, count);
+    const Scalar lr = Scalar(learning_rate);
+    // Bias corrections folded into the step size and epsilon
+    const Scalar correction1 = 1 - std::pow(beta1, Scalar(step_count));
+    const Scalar correction2 = std::sqrt(1 - std::pow(beta2, Scalar(step_count)));
+    const Scalar step_size = lr * correction2 / correction1;
+    const Scalar scaled_epsilon = epsilon * correction2;
+
+    if (decoupled_weight_decay) {
+        p *= 1 - lr * weight_decay;
+        m = beta1 * m + (1 - beta1) * grad;
+        v = beta2 * v + (1 - beta2) * grad.square();
+    } else {
+        auto g = grad + weight_decay * p;
+        m = beta1 * m + (1 - beta1) * g;
+        v = beta2 * v + (1 - beta2) * g.square();
+    }
+    p -= step_size * m / (v.sqrt() + scaled_epsilon);
+}
+
+AdamW::AdamW(double learning_rate, double beta1, double beta2, double epsilon, double weight_decay)
+    : Adam(learning_rate, beta1, beta2, epsilon, weight_decay) {
+    decoupled_weight_decay = true;
+}
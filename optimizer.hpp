@@ -0,0 +1,97 @@
+#pragma once
+#include "tensor.hpp"
+#include <string>
+
+/**
+ * @brief Parameter update rules, applied to a whole network at once
+ *
+ * Network packs every layer's parameters into one contiguous tensor and every
+ * gradient into another of the same layout (the layers' own tensors are views
+ * into them), so a step is a single element-wise pass over two flat arrays.
+ * That pass is split into chunks over ThreadPool::global(), and each chunk is one
+ * Eigen array expression, which vectorizes.
+ *
+ * Per-element state (momentum, moment estimates) is kept by position in the
+ * packed layout and restarts from zero whenever the parameter count changes.
+ */
+class Optimizer {
+public:
+    explicit Optimizer(double learning_rate) : learning_rate(learning_rate) {}
+    virtual ~Optimizer() = default;
+
+    virtual std::string name() const = 0;
+
+    // One update of parameters from gradients, two flat tensors of the same size
+    void step(Tensor& parameters, const Tensor& gradients);
+    // Forgets all state, as if no step had been taken
+    void reset();
+    long steps() const { return step_count; }
+
+    // Network::train() and train_batch() overwrite this with their learning_rate argument
+    double learning_rate;
+
+protected:
+    long step_count = 0;  // Including the step in progress
+
+    // Updates elements [begin, begin + count). Runs concurrently on disjoint ranges
+    virtual void update(Scalar* parameters, const Scalar* gradients, long begin, long count) = 0;
+    // Sizes the state for size elements, all zero
+    virtual void reset_state(long /*size*/) {}
+
+private:
+    long state_size = -1;
+};
+
+// Stochastic gradient descent with optional (Nesterov) momentum and L2 weight decay, as in PyTorch:
+//   g = grad + weight_decay * p
+//   v = momentum * v + g
+//   p -= learning_rate * (nesterov ? g + momentum * v : v)
+// With momentum 0 this is plain SGD, the network's default
+class SGD : public Optimizer {
+public:
+    explicit SGD(double learning_rate = 0.01, double momentum = 0, bool nesterov = false, double weight_decay = 0);
+    std::string name() const override { return nesterov ? "SGD (Nesterov)" : "SGD"; }
+
+    Scalar momentum;
+    bool nesterov;
+    Scalar weight_decay;
+
+protected:
+    void update(Scalar* parameters, const Scalar* gradients, long begin, long count) override;
+    void reset_state(long size) override;
+
+private:
+    ArrayXs velocity;
+};
+
+// Adam with bias-corrected moment estimates. weight_decay adds weight_decay * p to the gradient (L2)
+class Adam : public Optimizer {
+public:
+    explicit Adam(double learning_rate = 0.001, double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8,
+                  double weight_decay = 0);
+    std::string name() const override { return "Adam"; }
+
+    Scalar beta1;
+    Scalar beta2;
+    Scalar epsilon;
+    Scalar weight_decay;
+
+protected:
+    // AdamW: weight decay shrinks the parameters directly instead of going through the moments
+    bool decoupled_weight_decay = false;
+
+    void update(Scalar* parameters, const Scalar* gradients, long begin, long count) override;
+    void reset_state(long size) override;
+
+private:
+    ArrayXs first_moment;
+    ArrayXs second_moment;
+};
+
+// Adam with decoupled weight decay (Loshchilov & Hutter): p -= learning_rate * weight_decay * p every step
+class AdamW : public Adam {
+public:
+    explicit AdamW(double learning_rate = 0.001, double beta1 = 0.9, double beta2 = 0.999, double epsilon = 1e-8,
+                   double weight_decay = 0.01);
+    std::string name() const override { return "AdamW"; }
+};
@@ -0,0 +1,167 @@
+// Data-parallel and pipelined training against plain single-threaded training from identical parameters:
+// gradients of one batch and parameters after a few steps must agree to rounding, and
+// repeating a run with the same worker count must give bit-identical parameters.
+// Build and run with `make test_parallel`; exits non-zero if any check fails
+#include "network.hpp"
+#include "convolutional.hpp"
+#include "activations.hpp"
+#include "pooling.hpp"
+#include "reshape.hpp"
+#include "dense.hpp"
+#include "losses.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+    int failures = 0;
+    const double tolerance = std::is_same<Scalar, float>::value ? 1e-5 : 1e-10;
+
+    void check(bool ok, const std::string& what, double value) {
+        std::cout << (ok ? "ok   " : "FAIL ") << what << ": " << value << "\n";
+        if (!ok) {
+            failures++;
+        }
+    }
+
+    std::vector<std::shared_ptr<Layer>> make_layers() {
+        return {
+            std::make_shared<Convolutional>(std::vector<int>{2, 12, 12}, 3, 4, 1, 1),
+            std::make_shared<ReLU>(),
+            std::make_shared<MaxPooling>(2),
+            std::make_shared<Reshape>(std::vector<int>{4, 6, 6}, std::vector<int>{1, 144, 1}),
+            std::make_shared<Dense>(144, 16),
+            std::make_shared<Sigmoid>(),
+            std::make_shared<Dense>(16, 3),
+            std::make_shared<Softmax>()
+        };
+    }
+
+    // A network whose parameters are copied from reference
+    std::unique_ptr<Network> copy_of(const Network& reference) {
+        auto network = std::make_unique<Network>(make_layers());
+        for (size_t i = 0; i < reference.get_layers().size(); ++i) {
+            std::vector<Tensor*> source = reference.get_layers()[i]->parameters();
+            std::vector<Tensor*> target = network->get_layers()[i]->parameters();
+            for (size_t k = 0; k < source.size(); ++k) {
+                target[k]->flat() = source[k]->flat();
+            }
+            network->get_layers()[i]->parameters_changed();
+        }
+        return network;
+    }
+
+    // Largest difference over every parameter (or gradient) tensor of two networks
+    double max_difference(const Network& a, const Network& b, bool gradients) {
+        double difference = 0;
+        for (size_t i = 0; i < a.get_layers().size(); ++i) {
+            std::vector<Tensor*> x = gradients ? a.get_layers()[i]->gradients() : a.get_layers()[i]->parameters();
+            std::vector<Tensor*> y = gradients ? b.get_layers()[i]->gradients() : b.get_layers()[i]->parameters();
+            for (size_t k = 0; k < x.size(); ++k) {
+                difference = std::max<double>(difference, (x[k]->flat() - y[k]->flat()).cwiseAbs().maxCoeff());
+            }
+        }
+        return difference;
+    }
+
+    struct Data {
+        Tensor x{12, 2, 12, 12};
+        Tensor y{12, 1, 3, 1};
+    };
+
+    // Runs the same work on a serial network and two identically configured parallel ones
+    void compare(const std::string& name, const Network& initial, const Data& data,
+                 const std::function<void(Network&)>& configure) {
+        std::unique_ptr<Network> serial = copy_of(initial);
+        std::unique_ptr<Network> parallel = copy_of(initial);
+        std::unique_ptr<Network> repeat = copy_of(initial);
+        configure(*parallel);
+        configure(*repeat);
+
+        for (Network* network : {serial.get(), parallel.get()}) {
+            network->zero_gradients();
+            network->accumulate_gradients(data.x, data.y, Loss::cross_entropy_loss, Loss::cross_entropy_loss_prime);
+        }
+        check(max_difference(*serial, *parallel, true) <= tolerance, name + " gradients match serial",
+              max_difference(*serial, *parallel, true));
+
+        for (int step = 0; step < 4; ++step) {
+            for (Network* network : {serial.get(), parallel.get(), repeat.get()}) {
+                network->train_batch(data.x, data.y, Loss::cross_entropy_loss, Loss::cross_entropy_loss_prime, 0.1);
+            }
+        }
+        check(max_difference(*serial, *parallel, false) <= tolerance, name + " parameters match serial after 4 steps",
+              max_difference(*serial, *parallel, false));
+        check(max_difference(*parallel, *repeat, false) == 0, name + " repeated run is bit-identical",
+              max_difference(*parallel, *repeat, false));
+    }
+
+    void test_data_parallel(const Network& initial, const Data& data) {
+        std::cout << "\n=== Data parallel vs serial ===\n";
+        for (int workers : {2, 3}) {
+            compare(std::to_string(workers) + " workers", initial, data,
+                    [workers](Network& network) { network.set_data_parallel(workers); });
+        }
+    }
+
+    void test_pipeline(const Network& initial, const Data& data) {
+        std::cout << "\n=== Pipeline vs serial ===\n";
+        for (auto [stages, micro_batches] : std::vector<std::pair<int, int>>{{2, 4}, {3, 6}, {4, 12}, {3, 2}}) {
+            compare(std::to_string(stages) + " stages, " + std::to_string(micro_batches) + " micro-batches", initial,
+                    data, [=](Network& network) { network.set_pipeline(stages, micro_batches); });
+        }
+
+        // Two pipelines at once from two threads, both also using the global pool inside their layers
+        std::unique_ptr<Network> serial = copy_of(initial);
+        std::vector<std::unique_ptr<Network>> pipelined;
+        for (int i = 0; i < 2; ++i) {
+            pipelined.push_back(copy_of(initial));
+            pipelined.back()->set_pipeline(3, 6);
+        }
+        std::vector<std::thread> threads;
+        for (auto& network : pipelined) {
+            threads.emplace_back([&data, &network] {
+                for (int step = 0; step < 10; ++step) {
+                    network->train_batch(data.x, data.y, Loss::cross_entropy_loss, Loss::cross_entropy_loss_prime, 0.1);
+                }
+            });
+        }
+        for (int step = 0; step < 10; ++step) {
+            serial->train_batch(data.x, data.y, Loss::cross_entropy_loss, Loss::cross_entropy_loss_prime, 0.1);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        check(max_difference(*serial, *pipelined[0], false) <= tolerance,
+              "two concurrent pipelines finish and match serial", max_difference(*serial, *pipelined[0], false));
+        check(max_difference(*pipelined[0], *pipelined[1], false) == 0, "and match each other bit for bit",
+              max_difference(*pipelined[0], *pipelined[1], false));
+    }
+}
+
+int main() {
+    ThreadPool::set_num_threads(3);
+    std::mt19937 gen(11);
+    std::normal_distribution<double> dis;
+    Data data;
+    for (long i = 0; i < data.x.size(); ++i) {
+        data.x.data()[i] = Scalar(dis(gen));
+    }
+    for (int n = 0; n < data.x.batch(); ++n) {
+        data.y(n, 0, n % 3, 0) = 1;
+    }
+    Network initial(make_layers());
+
+    test_data_parallel(initial, data);
+    test_pipeline(initial, data);
+    std::cout << "\n" << (failures ? "FAILED " + std::to_string(failures) + " checks" : std::string("all passed")) << "\n";
+    return failures ? 1 : 0;
+}
@@ -6,44 +6,62 @@
 MaxPooling::MaxPooling(int kernel_size, int stride)
     : kernel_size(kernel_size), stride(stride == -1 ? kernel_size : stride) {}
 
-std::vector<Eigen::MatrixXd> MaxPooling::forward(const std::vector<Eigen::MatrixXd>& input) {
-    this->input = input;
-
-    int channels = input.size();
-    std::vector<Eigen::MatrixXd> output(channels);
-    max_row_indices.resize(channels);
-    max_col_indices.resize(channels);
-
-    for (int c = 0; c < channels; ++c) {
-        int in_rows = input[c].rows();
-        int in_cols = input[c].cols();
-        int out_rows = (in_rows - kernel_size) / stride + 1;
-        int out_cols = (in_cols - kernel_size) / stride + 1;
-
-        output[c] = Eigen::MatrixXd(out_rows, out_cols);
-        max_row_indices[c] = Eigen::MatrixXi(out_rows, out_cols);
-        max_col_indices[c] = Eigen::MatrixXi(out_rows, out_cols);
-
-        for (int i = 0; i < out_rows; ++i) {
-            for (int j = 0; j < out_cols; ++j) {
-                double max_val = -std::numeric_limits<double>::infinity();
-                int max_row = 0, max_col = 0;
-
-                for (int m = 0; m < kernel_size; ++m) {
-                    for (int n = 0; n < kernel_size; ++n) {
-                        int row_idx = i * stride + m;
-                        int col_idx = j * stride + n;
-                        if (input[c](row_idx, col_idx) > max_val) {
-                            max_val = input[c](row_idx, col_idx);
-                            max_row = row_idx;
-                            max_col = col_idx;
+Tensor MaxPooling::forward(const Tensor& input) {
+    if (training) {
+        this->input = input;
+    }
+
+    int batch = input.batch();
+    int channels = input.channels();
+    int in_rows = input.height();
+    int in_cols = input.width();
+    int out_rows = (in_rows - kernel_size) / stride + 1;
+    int out_cols = (in_cols - kernel_size) / stride + 1;
+
+    Tensor output = make_output({batch, channels, out_rows, out_cols});
+    // Argmax positions are only needed to route the gradient in backward. Index
+    // matrices keep their storage between calls of the same shape
+    if (training) {
+        max_row_indices.resize(batch * channels);
+        max_col_indices.resize(batch * channels);
+    }
+
+    for (int b = 0; b < batch; ++b) {
+        for (int c = 0; c < channels; ++c) {
+            auto in = input.channel(b, c);
+            auto out = output.channel(b, c);
+            Eigen::MatrixXi* max_rows = nullptr;
+            Eigen::MatrixXi* max_cols = nullptr;
+            if (training) {
+                max_rows = &max_row_indices[b * channels + c];
+                max_cols = &max_col_indices[b * channels + c];
+                max_rows->resize(out_rows, out_cols);
+                max_cols->resize(out_rows, out_cols);
+            }
+
+            for (int i = 0; i < out_rows; ++i) {
+                for (int j = 0; j < out_cols; ++j) {
+                    Scalar max_val = -std::numeric_limits<Scalar>::infinity();
+                    int max_row = 0, max_col = 0;
+
+                    for (int m = 0; m < kernel_size; ++m) {
+                        for (int n = 0; n < kernel_size; ++n) {
+                            int row_idx = i * stride + m;
+                            int col_idx = j * stride + n;
+                            if (in(row_idx, col_idx) > max_val) {
+                                max_val = in(row_idx, col_idx);
+                                max_row = row_idx;
+                                max_col = col_idx;
+                            }
                         }
                     }
-                }
 
-                output[c](i, j) = max_val;
-                max_row_indices[c](i, j) = max_row;
-                max_col_indices[c](i, j) = max_col;
+                    out(i, j) = max_val;
+                    if (max_rows) {
+                        (*max_rows)(i, j) = max_row;
+                        (*max_cols)(i, j) = max_col;
+                    }
+                }
             }
         }
     }
@@ -51,17 +69,33 @@ std::vector<Eigen::MatrixXd> MaxPooling::forward(const std::vector<Eigen::Matrix
     return output;
 }
 
-std::vector<Eigen::MatrixXd> MaxPooling::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    std::vector<Eigen::MatrixXd> input_gradient(input.size());
+Tensor::Shape MaxPooling::output_shape(const Tensor::Shape& input_shape) const {
+    return {input_shape[0], input_shape[1], (input_shape[2] - kernel_size) / stride + 1,
+            (input_shape[3] - kernel_size) / stride + 1};
+}
+
+void MaxPooling::set_training(bool training) {
+    Layer::set_training(training);
+    if (!training) {
+        max_row_indices.clear();
+        max_col_indices.clear();
+    }
+}
 
-    for (size_t c = 0; c < input.size(); ++c) {
-        input_gradient[c] = Eigen::MatrixXd::Zero(input[c].rows(), input[c].cols());
+Tensor MaxPooling::backward(const Tensor& output_gradient) {
+    Tensor input_gradient = make_input_gradient(input.shape());
 
-        for (int i = 0; i < output_gradient[c].rows(); ++i) {
-            for (int j = 0; j < output_gradient[c].cols(); ++j) {
-                int row_idx = max_row_indices[c](i, j);
-                int col_idx = max_col_indices[c](i, j);
-                input_gradient[c](row_idx, col_idx) += output_gradient[c](i, j);
+    for (int b = 0; b < input.batch(); ++b) {
+        for (int c = 0; c < input.channels(); ++c) {
+            auto grad_in = input_gradient.channel(b, c);
+            auto grad_out = output_gradient.channel(b, c);
+            const Eigen::MatrixXi& max_rows = max_row_indices[b * input.channels() + c];
+            const Eigen::MatrixXi& max_cols = max_col_indices[b * input.channels() + c];
+
+            for (int i = 0; i < grad_out.rows(); ++i) {
+                for (int j = 0; j < grad_out.cols(); ++j) {
+                    grad_in(max_rows(i, j), max_cols(i, j)) += grad_out(i, j);
+                }
             }
         }
     }
@@ -74,33 +108,34 @@ std::vector<Eigen::MatrixXd> MaxPooling::backward(const std::vector<Eigen::Matri
 AveragePooling::AveragePooling(int kernel_size, int stride)
     : kernel_size(kernel_size), stride(stride == -1 ? kernel_size : stride) {}
 
-std::vector<Eigen::MatrixXd> AveragePooling::forward(const std::vector<Eigen::MatrixXd>& input) {
-    this->input = input;
-
-    int channels = input.size();
-    std::vector<Eigen::MatrixXd> output(channels);
+Tensor AveragePooling::forward(const Tensor& input) {
+    if (training) {
+        this->input = input;
+    }
 
-    for (int c = 0; c < channels; ++c) {
-        int in_rows = input[c].rows();
-        int in_cols = input[c].cols();
-        int out_rows = (in_rows - kernel_size) / stride + 1;
-        int out_cols = (in_cols - kernel_size) / stride + 1;
+    int out_rows = (input.height() - kernel_size) / stride + 1;
+    int out_cols = (input.width() - kernel_size) / stride + 1;
+    Tensor output = make_output({input.batch(), input.channels(), out_rows, out_cols});
 
-        output[c] = Eigen::MatrixXd(out_rows, out_cols);
+    for (int b = 0; b < input.batch(); ++b) {
+        for (int c = 0; c < input.channels(); ++c) {
+            auto in = input.channel(b, c);
+            auto out = output.channel(b, c);
 
-        for (int i = 0; i < out_rows; ++i) {
-            for (int j = 0; j < out_cols; ++j) {
-                double sum = 0.0;
+            for (int i = 0; i < out_rows; ++i) {
+                for (int j = 0; j < out_cols; ++j) {
+                    Scalar sum = 0;
 
-                for (int m = 0; m < kernel_size; ++m) {
-                    for (int n = 0; n < kernel_size; ++n) {
-                        int row_idx = i * stride + m;
-                        int col_idx = j * stride + n;
-                        sum += input[c](row_idx, col_idx);
+                    for (int m = 0; m < kernel_size; ++m) {
+                        for (int n = 0; n < kernel_size; ++n) {
+                            int row_idx = i * stride + m;
+                            int col_idx = j * stride + n;
+                            sum += in(row_idx, col_idx);
+                        }
                     }
-                }
 
-                output[c](i, j) = sum / (kernel_size * kernel_size);
+                    out(i, j) = sum / (kernel_size * kernel_size);
+                }
             }
         }
     }
@@ -108,21 +143,29 @@ std::vector<Eigen::MatrixXd> AveragePooling::forward(const std::vector<Eigen::Ma
     return output;
 }
 
-std::vector<Eigen::MatrixXd> AveragePooling::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    std::vector<Eigen::MatrixXd> input_gradient(input.size());
+Tensor::Shape AveragePooling::output_shape(const Tensor::Shape& input_shape) const {
+    return {input_shape[0], input_shape[1], (input_shape[2] - kernel_size) / stride + 1,
+            (input_shape[3] - kernel_size) / stride + 1};
+}
+
+Tensor AveragePooling::backward(const Tensor& output_gradient) {
+    Tensor input_gradient = make_input_gradient(input.shape());
 
-    for (size_t c = 0; c < input.size(); ++c) {
-        input_gradient[c] = Eigen::MatrixXd::Zero(input[c].rows(), input[c].cols());
+    for (int b = 0; b < input.batch(); ++b) {
+        for (int c = 0; c < input.channels(); ++c) {
+            auto grad_in = input_gradient.channel(b, c);
+            auto grad_out = output_gradient.channel(b, c);
 
-        for (int i = 0; i < output_gradient[c].rows(); ++i) {
-            for (int j = 0; j < output_gradient[c].cols(); ++j) {
-                double grad = output_gradient[c](i, j) / (kernel_size * kernel_size);
+            for (int i = 0; i < grad_out.rows(); ++i) {
+                for (int j = 0; j < grad_out.cols(); ++j) {
+                    Scalar grad = grad_out(i, j) / (kernel_size * kernel_size);
 
-                for (int m = 0; m < kernel_size; ++m) {
-                    for (int n = 0; n < kernel_size; ++n) {
-                        int row_idx = i * stride + m;
-                        int col_idx = j * stride + n;
-                        input_gradient[c](row_idx, col_idx) += grad;
+                    for (int m = 0; m < kernel_size; ++m) {
+                        for (int n = 0; n < kernel_size; ++n) {
+                            int row_idx = i * stride + m;
+                            int col_idx = j * stride + n;
+                            grad_in(row_idx, col_idx) += grad;
+                        }
                     }
                 }
             }
@@ -134,45 +177,42 @@ std::vector<Eigen::MatrixXd> AveragePooling::backward(const std::vector<Eigen::M
 
 // GlobalAvgPooling Implementation
 // ------------------------------------------------------------------------------------
-GlobalAvgPooling::GlobalAvgPooling(int kernel_size, int stride) 
+GlobalAvgPooling::GlobalAvgPooling(int kernel_size, int stride)
     : kernel_size(kernel_size), stride(stride) {}
 
-std::vector<Eigen::MatrixXd> GlobalAvgPooling::forward(const std::vector<Eigen::MatrixXd>& input) {
+Tensor GlobalAvgPooling::forward(const Tensor& input) {
     // Store input shape for backward pass
-    input_shape = {static_cast<int>(input.size()), // channels
-                  static_cast<int>(input[0].rows()), // height
-                  static_cast<int>(input[0].cols())}; // width
-    
+    input_shape = input.shape();
+
     // Initialize output with same number of channels but 1x1 size
-    std::vector<Eigen::MatrixXd> output(input.size());
-    
-    for (size_t c = 0; c < input.size(); ++c) {
-        // Calculate mean of entire feature map
-        output[c] = Eigen::MatrixXd::Zero(1, 1); // Init. output element(for one channel/feature map)
-        output[c](0, 0) = input[c].mean();
+    Tensor output = make_output(output_shape(input_shape));
+
+    for (int b = 0; b < input.batch(); ++b) {
+        for (int c = 0; c < input.channels(); ++c) {
+            // Calculate mean of entire feature map
+            output(b, c, 0, 0) = input.channel(b, c).mean();
+        }
     }
-    
+
     return output;
 }
 
-std::vector<Eigen::MatrixXd> GlobalAvgPooling::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    
-    std::vector<Eigen::MatrixXd> input_gradient(input_shape[0]);
-    
-    for (size_t c = 0; c < input_shape[0]; ++c) {
-        // Get the gradient value for this channel
-        double grad = output_gradient[c](0, 0);
-        
-        // Calculate the scaling factor (1/N where N is total number of elements)
-        double scale = grad / (input_shape[1] * input_shape[2]);
-        
-        // Distribute gradient equally to all positions
-        input_gradient[c] = Eigen::MatrixXd::Constant(
-            input_shape[1], 
-            input_shape[2], 
-            scale
-        );
+Tensor GlobalAvgPooling::backward(const Tensor& output_gradient) {
+
+    Tensor input_gradient = make_input_gradient(input_shape);
+
+    for (int b = 0; b < input_shape[0]; ++b) {
+        for (int c = 0; c < input_shape[1]; ++c) {
+            // Get the gradient value for this channel
+            Scalar grad = output_gradient(b, c, 0, 0);
+
+            // Calculate the scaling factor (1/N where N is total number of elements)
+            Scalar scale = grad / (input_shape[2] * input_shape[3]);
+
+            // Distribute gradient equally to all positions
+            input_gradient.channel(b, c).setConstant(scale);
+        }
     }
-    
+
     return input_gradient;
 }
@@ -10,11 +10,19 @@ public:
     // Stride is set to kernel size when not explicitly mentioned
     MaxPooling(int kernel_size, int stride = -1);
 
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "MaxPooling"; }
+    std::shared_ptr<Layer> clone() const override { return std::make_shared<MaxPooling>(kernel_size, stride); }
+    void set_training(bool training) override;
+    Tensor::Shape output_shape(const Tensor::Shape& input_shape) const override;
+
+    int pool_size() const { return kernel_size; }
+    int pool_stride() const { return stride; }
 
 private:
     int kernel_size, stride;
+    // Indexed [sample * channels + channel]
     std::vector<Eigen::MatrixXi> max_row_indices;
     std::vector<Eigen::MatrixXi> max_col_indices;
 };
@@ -23,8 +31,11 @@ class AveragePooling : public Layer {
 public:
     AveragePooling(int kernel_size, int stride = -1);
 
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "AveragePooling"; }
+    std::shared_ptr<Layer> clone() const override { return std::make_shared<AveragePooling>(kernel_size, stride); }
+    Tensor::Shape output_shape(const Tensor::Shape& input_shape) const override;
 
 private:
     int kernel_size, stride;
@@ -54,23 +65,27 @@ public:
 
     /**
      * @brief Forward pass of global average pooling
-     * @param input Input feature maps [channels][height][width]
-     * @return Output feature maps reduced to [channels][1][1]
+     * @param input Input feature maps [batch][channels][height][width]
+     * @return Output feature maps reduced to [batch][channels][1][1]
      */
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
+    Tensor forward(const Tensor& input) override;
 
     /**
      * @brief Backward pass of global average pooling
      * @param output_gradient Gradient from the next layer
-     * @param learning_rate Learning rate for parameter updates (not used in pooling)
      * @return Gradient with respect to input
      */
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "GlobalAvgPooling"; }
+    std::shared_ptr<Layer> clone() const override { return std::make_shared<GlobalAvgPooling>(kernel_size, stride); }
+    Tensor::Shape output_shape(const Tensor::Shape& input_shape) const override {
+        return {input_shape[0], input_shape[1], 1, 1};
+    }
 
 private:
     int kernel_size;  // Not used in global pooling, kept for interface consistency
     int stride;       // Not used in global pooling, kept for interface consistency
-    std::vector<int> input_shape;  // Store input shape for backward pass: (num_filters, )
+    Tensor::Shape input_shape;  // Store input shape for backward pass: (batch, num_filters, height, width)
 };
 
 #endif // POOLING_HPP
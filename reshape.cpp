@@ -4,7 +4,7 @@
 #include <stdexcept>
 
 Reshape::Reshape(const std::vector<int>& input_shape, const std::vector<int>& output_shape)
-    : input_shape(input_shape), output_shape(output_shape) {
+    : input_shape(input_shape), new_shape(output_shape) {
     if (total_size(input_shape) != total_size(output_shape)) {
         throw std::invalid_argument("Total elements in input and output shapes must be the same.");
     }
@@ -14,50 +14,16 @@ int Reshape::total_size(const std::vector<int>& shape) {
     return shape[0] * shape[1] * shape[2];
 }
 
-std::vector<Eigen::MatrixXd> Reshape::forward(const std::vector<Eigen::MatrixXd>& input) {
-    this->input = input;
-
-    // Flatten input matrices in row-major order
-    Eigen::VectorXd flattened(total_size(input_shape));
-    int idx = 0;
-    for (const auto& mat : input) {
-        for (int i = 0; i < mat.rows(); ++i)
-            for (int j = 0; j < mat.cols(); ++j)
-                flattened(idx++) = mat(i, j);
-    }
-
-    // Reshape flattened vector to output shape in row-major order
-    std::vector<Eigen::MatrixXd> output(output_shape[0]);
-    idx = 0;
-    for (int ch = 0; ch < output_shape[0]; ++ch) {
-        output[ch] = Eigen::MatrixXd(output_shape[1], output_shape[2]);
-        for (int i = 0; i < output_shape[1]; ++i)
-            for (int j = 0; j < output_shape[2]; ++j)
-                output[ch](i, j) = flattened(idx++);
+Tensor Reshape::forward(const Tensor& input) {
+    // NCHW storage is already the row-major flattening of each sample, so the
+    // output is a view of the input with the new shape and no data moves
+    if (input.sample_size() != total_size(input_shape)) {
+        throw std::invalid_argument("Reshape input does not match the configured input shape.");
     }
-
-    return output;
+    return input.reshaped(input.batch(), new_shape[0], new_shape[1], new_shape[2]);
 }
 
-std::vector<Eigen::MatrixXd> Reshape::backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) {
-    // Flatten output gradients in row-major order
-    Eigen::VectorXd flattened(total_size(output_shape));
-    int idx = 0;
-    for (const auto& mat : output_gradient) {
-        for (int i = 0; i < mat.rows(); ++i)
-            for (int j = 0; j < mat.cols(); ++j)
-                flattened(idx++) = mat(i, j);
-    }
-
-    // Reshape flattened vector back to input shape in row-major order
-    std::vector<Eigen::MatrixXd> input_gradient(input_shape[0]);
-    idx = 0;
-    for (int ch = 0; ch < input_shape[0]; ++ch) {
-        input_gradient[ch] = Eigen::MatrixXd(input_shape[1], input_shape[2]);
-        for (int i = 0; i < input_shape[1]; ++i)
-            for (int j = 0; j < input_shape[2]; ++j)
-                input_gradient[ch](i, j) = flattened(idx++);
-    }
-
-    return input_gradient;
+Tensor Reshape::backward(const Tensor& output_gradient) {
+    // Reshape the gradient back to input shape, again as a view
+    return output_gradient.reshaped(output_gradient.batch(), input_shape[0], input_shape[1], input_shape[2]);
 }
\ No newline at end of file
@@ -9,12 +9,20 @@ class Reshape : public Layer {
 public:
     Reshape(const std::vector<int>& input_shape, const std::vector<int>& output_shape);
 
-    std::vector<Eigen::MatrixXd> forward(const std::vector<Eigen::MatrixXd>& input) override;
-    std::vector<Eigen::MatrixXd> backward(const std::vector<Eigen::MatrixXd>& output_gradient, double learning_rate) override;
+    // The batch dimension is passed through unchanged. Both directions return views
+    // sharing storage with their argument, so nothing is copied
+    Tensor forward(const Tensor& input) override;
+    Tensor backward(const Tensor& output_gradient) override;
+    std::string name() const override { return "Reshape"; }
+    std::shared_ptr<Layer> clone() const override { return std::make_shared<Reshape>(input_shape, new_shape); }
+    Tensor::Shape output_shape(const Tensor::Shape& input) const override {
+        return {input[0], new_shape[0], new_shape[1], new_shape[2]};
+    }
+    bool returns_views() const override { return true; }
 
 private:
     std::vector<int> input_shape;  // [input_depth, height, width]
-    std::vector<int> output_shape; // [output_depth, new_height, new_width]
+    std::vector<int> new_shape;    // [output_depth, new_height, new_width]
 
     int total_size(const std::vector<int>& shape);
 };
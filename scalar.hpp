@@ -0,0 +1,16 @@
+#pragma once
+#include <Eigen/Dense>
+
+// Floating point type used by every tensor, layer, loss and loader.
+// Double by default; build with -DNN_FLOAT32 (make PRECISION=float32) for single precision.
+// Hyperparameters (learning rates) and reported losses stay double either way.
+#ifdef NN_FLOAT32
+typedef float Scalar;
+#else
+typedef double Scalar;
+#endif
+
+typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> MatrixXs;
+typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> VectorXs;
+typedef Eigen::Array<Scalar, Eigen::Dynamic, Eigen::Dynamic> ArrayXXs;
+typedef Eigen::Array<Scalar, Eigen::Dynamic, 1> ArrayXs;
@@ -12,10 +12,10 @@
 #include <algorithm>
 
 // Function to generate random 2x2 binary matrices and their sums
-std::pair<std::vector<std::vector<Eigen::MatrixXd>>, std::vector<std::vector<Eigen::MatrixXd>>> 
+std::pair<Tensor, Tensor> 
 generate_data(int num_samples) {
-    std::vector<std::vector<Eigen::MatrixXd>> inputs;
-    std::vector<std::vector<Eigen::MatrixXd>> targets;
+    Tensor inputs(num_samples, 1, 8, 8);
+    Tensor targets(num_samples, 1, 1, 1);
     
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -23,43 +23,31 @@ generate_data(int num_samples) {
     
     for (int i = 0; i < num_samples; ++i) {
         // Generate random 2x2 binary matrix
-        Eigen::MatrixXd input(8, 8);
+        auto input = inputs.channel(i, 0);
         for (int j = 0; j < 8; ++j) {
             for (int k = 0; k < 8; ++k) {
                 input(j, k) = dis(gen);
             }
         }
         
-        // Calculate sum
-        double sum = input.sum();
-        
-        // Create target matrix (1x1 with the sum)
-        Eigen::MatrixXd target(1, 1);
-        target(0, 0) = sum;
-        
-        inputs.push_back({input});
-        targets.push_back({target});
+        // Target (1x1 with the sum)
+        targets(i, 0, 0, 0) = input.sum();
     }
     
     return {inputs, targets};
 }
 
 // Mean Squared Error loss function
-double mse(const std::vector<Eigen::MatrixXd>& y_true, const std::vector<Eigen::MatrixXd>& y_pred) {
-    double loss = 0.0;
-    for (size_t i = 0; i < y_true.size(); ++i) {
-        loss += (y_true[i] - y_pred[i]).array().square().sum();
-    }
-    return loss / y_true.size();
+double mse(const Tensor& y_true, const Tensor& y_pred) {
+    double loss = (y_true.flat() - y_pred.flat()).array().square().sum();
+    return loss / (y_true.batch() * y_true.channels());
 }
 
 // MSE derivative
-std::vector<Eigen::MatrixXd> mse_prime(const std::vector<Eigen::MatrixXd>& y_true, 
-                                     const std::vector<Eigen::MatrixXd>& y_pred) {
-    std::vector<Eigen::MatrixXd> grad(y_true.size());
-    for (size_t i = 0; i < y_true.size(); ++i) {
-        grad[i] = 2.0 * (y_pred[i] - y_true[i]) / y_true.size();
-    }
+Tensor mse_prime(const Tensor& y_true, 
+                 const Tensor& y_pred) {
+    Tensor grad(y_true.shape());
+    grad.flat() = 2.0 * (y_pred.flat() - y_true.flat()) / (y_true.batch() * y_true.channels());
     return grad;
 }
 
@@ -96,20 +84,21 @@ int main() {
                  true); // verbose
     
     // Test network
+    network.set_training(false);
     double total_error = 0.0;
-    for (size_t i = 0; i < x_test.size(); ++i) {
-        auto output = network.predict(x_test[i]);
-        double predicted_sum = output[0](0, 0);
-        double true_sum = y_test[i][0](0, 0);
+    for (int i = 0; i < x_test.batch(); ++i) {
+        auto output = network.predict(x_test.sample(i));
+        double predicted_sum = output(0, 0, 0, 0);
+        double true_sum = y_test(i, 0, 0, 0);
         
-        std::cout << "Input matrix:\n" << x_test[i][0] << "\n";
+        std::cout << "Input matrix:\n" << x_test.channel(i, 0) << "\n";
         std::cout << "Predicted sum: " << predicted_sum << ", True sum: " << true_sum << "\n";
         std::cout << "Error: " << std::abs(predicted_sum - true_sum) << "\n\n";
         
         total_error += std::abs(predicted_sum - true_sum);
     }
     
-    std::cout << "Average absolute error: " << total_error / x_test.size() << std::endl;
+    std::cout << "Average absolute error: " << total_error / x_test.batch() << std::endl;
     
     return 0;
 } 
\ No newline at end of file
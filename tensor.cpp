@@ -0,0 +1,127 @@
+#include "tensor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+
+namespace {
+    std::atomic<long long> total_allocated{0};
+}
+
+long long Tensor::allocated_bytes() {
+    return total_allocated.load(std::memory_order_relaxed);
+}
+
+Tensor::Tensor() : ptr(nullptr) {
+    set_shape({0, 0, 0, 0});
+}
+
+Tensor::Tensor(int batch, int channels, int height, int width)
+    : Tensor(Shape{batch, channels, height, width}) {}
+
+Tensor::Tensor(const Shape& shape) : ptr(nullptr) {
+    set_shape(shape);
+    if (size() == 0) {
+        return;
+    }
+
+    // aligned_alloc wants the byte count to be a multiple of the alignment
+    std::size_t bytes = size() * sizeof(Scalar);
+    bytes = (bytes + alignment - 1) / alignment * alignment;
+    void* raw = std::aligned_alloc(alignment, bytes);
+    if (!raw) {
+        throw std::bad_alloc();
+    }
+    storage = std::shared_ptr<Scalar>(static_cast<Scalar*>(raw), [](Scalar* p) { std::free(p); });
+    ptr = storage.get();
+    total_allocated.fetch_add(bytes, std::memory_order_relaxed);
+    set_zero();
+}
+
+Tensor Tensor::external(Scalar* data, const Shape& shape, std::shared_ptr<void> owner) {
+    Tensor result;
+    result.set_shape(shape);
+    // Aliasing constructor: shares owner's reference count but points at data
+    result.storage = std::shared_ptr<Scalar>(std::move(owner), data);
+    result.ptr = data;
+    return result;
+}
+
+void Tensor::set_shape(const Shape& shape) {
+    for (int d : shape) {
+        if (d < 0) {
+            throw std::invalid_argument("Tensor dimensions must be non-negative");
+        }
+    }
+    dims = shape;
+    steps[3] = 1;
+    steps[2] = dims[3];
+    steps[1] = static_cast<long>(dims[2]) * dims[3];
+    steps[0] = static_cast<long>(dims[1]) * steps[1];
+}
+
+Tensor Tensor::sample(int n) const {
+    return slice(n, 1);
+}
+
+Tensor Tensor::slice(int start, int count) const {
+    if (start < 0 || count < 0 || start + count > dims[0]) {
+        throw std::out_of_range("Tensor sample index out of range");
+    }
+    Tensor view = *this;
+    view.ptr = ptr + start * steps[0];
+    view.set_shape({count, dims[1], dims[2], dims[3]});
+    return view;
+}
+
+Tensor Tensor::reshaped(int batch, int channels, int height, int width) const {
+    Tensor view = *this;
+    view.set_shape({batch, channels, height, width});
+    if (view.size() != size()) {
+        throw std::invalid_argument("Total elements in input and output shapes must be the same.");
+    }
+    return view;
+}
+
+Tensor Tensor::view(long offset, const Shape& shape) const {
+    Tensor view = *this;
+    view.ptr = ptr + offset;
+    view.set_shape(shape);
+    if (offset < 0 || offset + view.size() > size()) {
+        throw std::out_of_range("Tensor view does not fit inside its parent");
+    }
+    return view;
+}
+
+Tensor Tensor::clone() const {
+    Tensor copy(dims);
+    std::copy(ptr, ptr + size(), copy.ptr);
+    return copy;
+}
+
+void Tensor::set_zero() {
+    std::fill(ptr, ptr + size(), Scalar(0));
+}
+
+Tensor Tensor::from_channels(const std::vector<MatrixXs>& channels) {
+    if (channels.empty()) {
+        return Tensor();
+    }
+    Tensor result(1, channels.size(), channels[0].rows(), channels[0].cols());
+    for (size_t c = 0; c < channels.size(); ++c) {
+        if (channels[c].rows() != result.height() || channels[c].cols() != result.width()) {
+            throw std::invalid_argument("All channels must have the same dimensions");
+        }
+        result.channel(0, c) = channels[c];
+    }
+    return result;
+}
+
+std::vector<MatrixXs> Tensor::to_channels(int n) const {
+    std::vector<MatrixXs> result(dims[1]);
+    for (int c = 0; c < dims[1]; ++c) {
+        result[c] = channel(n, c);
+    }
+    return result;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "scalar.hpp"
+#include <array>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Contiguous 4-D tensor in NCHW layout: [batch][channels][height][width]
+ *
+ * All elements live in one 64-byte aligned buffer, and each (sample, channel)
+ * plane is stored row-major, so the whole thing is the same order the old
+ * Reshape layer flattened in. Copying a Tensor is shallow: both copies share
+ * the same storage (like a handle). Use clone() when a deep copy is needed.
+ */
+class Tensor {
+public:
+    using Shape = std::array<int, 4>;
+    using Strides = std::array<long, 4>;
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+    using MatrixMap = Eigen::Map<Matrix>;
+    using ConstMatrixMap = Eigen::Map<const Matrix>;
+    using VectorMap = Eigen::Map<VectorXs>;
+    using ConstVectorMap = Eigen::Map<const VectorXs>;
+
+    static constexpr std::size_t alignment = 64;
+
+    Tensor();
+    // Allocates a zero-initialised tensor
+    Tensor(int batch, int channels, int height, int width);
+    explicit Tensor(const Shape& shape);
+    // Tensor over memory it does not own, e.g. a memory-mapped file. owner is kept alive
+    // for as long as any view of the result exists. data should be aligned to alignment
+    static Tensor external(Scalar* data, const Shape& shape, std::shared_ptr<void> owner);
+
+    int batch() const { return dims[0]; }
+    int channels() const { return dims[1]; }
+    int height() const { return dims[2]; }
+    int width() const { return dims[3]; }
+    const Shape& shape() const { return dims; }
+    const Strides& strides() const { return steps; }
+    long size() const { return steps[0] * dims[0]; }
+    long sample_size() const { return steps[0]; }
+    bool empty() const { return size() == 0; }
+
+    Scalar* data() { return ptr; }
+    const Scalar* data() const { return ptr; }
+
+    Scalar& operator()(int n, int c, int h, int w) {
+        return ptr[n * steps[0] + c * steps[1] + h * steps[2] + w];
+    }
+    Scalar operator()(int n, int c, int h, int w) const {
+        return ptr[n * steps[0] + c * steps[1] + h * steps[2] + w];
+    }
+
+    // One (height x width) plane of sample n, viewed as an Eigen matrix
+    MatrixMap channel(int n, int c) {
+        return MatrixMap(ptr + n * steps[0] + c * steps[1], dims[2], dims[3]);
+    }
+    ConstMatrixMap channel(int n, int c) const {
+        return ConstMatrixMap(ptr + n * steps[0] + c * steps[1], dims[2], dims[3]);
+    }
+
+    // Whole buffer viewed as a (rows x cols) row-major matrix, rows * cols must equal size()
+    MatrixMap matrix(long rows, long cols) { return MatrixMap(ptr, rows, cols); }
+    ConstMatrixMap matrix(long rows, long cols) const { return ConstMatrixMap(ptr, rows, cols); }
+
+    VectorMap flat() { return VectorMap(ptr, size()); }
+    ConstVectorMap flat() const { return ConstVectorMap(ptr, size()); }
+
+    // View of sample n (batch of 1) sharing this tensor's storage
+    Tensor sample(int n) const;
+    // View of samples [start, start + count) sharing this tensor's storage
+    Tensor slice(int start, int count) const;
+    // View with a different shape but the same number of elements, sharing storage
+    Tensor reshaped(int batch, int channels, int height, int width) const;
+    // View of any shape that starts offset elements in and fits inside this tensor, sharing storage.
+    // This is how Network hands out pieces of its activation arena
+    Tensor view(long offset, const Shape& shape) const;
+    Tensor clone() const;
+    void set_zero();
+
+    bool same_shape(const Tensor& other) const { return dims == other.dims; }
+
+    // Conversions to and from the old per-channel representation (single sample)
+    static Tensor from_channels(const std::vector<MatrixXs>& channels);
+    std::vector<MatrixXs> to_channels(int n = 0) const;
+
+    // Running total of bytes ever allocated for tensor storage (external memory not included), across all threads.
+    // The profiler diffs it around each layer call
+    static long long allocated_bytes();
+
+private:
+    std::shared_ptr<Scalar> storage;
+    Scalar* ptr;
+    Shape dims;
+    Strides steps;
+
+    void set_shape(const Shape& shape);
+};
@@ -3,7 +3,7 @@
 #include <iomanip>
 
 // Helper to print a single matrix
-void printMatrix(const Eigen::MatrixXd& m, const std::string& name) {
+void printMatrix(const MatrixXs& m, const std::string& name) {
     std::cout << name << ":\n" << m << "\n";
 }
 
@@ -19,25 +19,19 @@ void test_loader_two() {
     while (loader.has_next_batch()) {
         auto [inputs, labels] = loader.get_next_batch();
         std::cout << "\nBatch " << batch_idx++ 
-                  << " (size = " << inputs.size() << ")\n";
+                  << " (size = " << inputs.batch() << ")\n";
         std::cout << "-------------------------------------\n";
 
-        for (size_t i = 0; i < inputs.size(); ++i) {
+        for (int i = 0; i < inputs.batch(); ++i) {
             // --- Decode the label ---
-            // labels[i] is vector<Eigen::MatrixXd>, with a single one-hot matrix at [0]
-            const auto& one_hot = labels[i][0];
+            // labels is (batch, 1, num_classes, 1), one one-hot column per sample
+            auto one_hot = labels.channel(i, 0);
             int label_index;
             one_hot.col(0).maxCoeff(&label_index);
             const std::string& label_str = dataset.labels[label_index];
 
             // --- Compute mean pixel over all channels ---
-            double sum = 0.0;
-            int total_pixels = 0;
-            for (const auto& channel_mat : inputs[i]) {
-                sum += channel_mat.sum();
-                total_pixels += channel_mat.rows() * channel_mat.cols();
-            }
-            double mean_pixel = sum / total_pixels;
+            double mean_pixel = inputs.sample(i).flat().mean();
 
             // --- Print a meaningful summary ---
             std::cout << " Image " << i 
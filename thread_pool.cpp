@@ -0,0 +1,113 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+namespace {
+    // Set on pool worker threads so nested parallel_for calls run inline
+    thread_local bool inside_worker = false;
+
+    std::unique_ptr<ThreadPool> global_pool;
+    std::mutex global_mutex;
+}
+
+ThreadPool::ThreadPool(int num_threads) {
+    // Only callers outside the pool add jobs, so this is rarely outgrown
+    jobs.reserve(16);
+    for (int i = 1; i < num_threads; ++i) {
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_available.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+bool ThreadPool::runs_inline(int count) const {
+    return inside_worker || std::min(count, num_threads()) == 1;
+}
+
+ThreadPool::Job* ThreadPool::claimable_job() const {
+    for (Job* job : jobs) {
+        if (job->next_chunk < job->num_chunks) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void ThreadPool::run_chunk(Job& job, int chunk, std::unique_lock<std::mutex>& lock) {
+    int chunk_begin = job.begin + static_cast<long>(job.count) * chunk / job.num_chunks;
+    int chunk_end = job.begin + static_cast<long>(job.count) * (chunk + 1) / job.num_chunks;
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+        for (int i = chunk_begin; i < chunk_end; ++i) {
+            job.call(job.body, i);
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    lock.lock();
+    if (error) {
+        job.error = error;
+    }
+    if (--job.remaining == 0) {
+        chunk_done.notify_all();
+    }
+}
+
+void ThreadPool::worker_loop() {
+    inside_worker = true;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        Job* job = nullptr;
+        task_available.wait(lock, [this, &job] { return stopping || (job = claimable_job()) != nullptr; });
+        if (!job) {
+            return;
+        }
+        run_chunk(*job, job->next_chunk++, lock);
+    }
+}
+
+void ThreadPool::run(Job& job) {
+    job.num_chunks = std::min(job.count, num_threads());
+    job.remaining = job.num_chunks;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    jobs.push_back(&job);
+    task_available.notify_all();
+
+    // The caller works through its own job too, so it finishes even if every worker is busy elsewhere
+    while (job.next_chunk < job.num_chunks) {
+        run_chunk(job, job.next_chunk++, lock);
+    }
+    chunk_done.wait(lock, [&job] { return job.remaining == 0; });
+    jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+bool ThreadPool::on_worker_thread() {
+    return inside_worker;
+}
+
+ThreadPool& ThreadPool::global() {
+    std::lock_guard<std::mutex> lock(global_mutex);
+    if (!global_pool) {
+        global_pool = std::make_unique<ThreadPool>(1);
+    }
+    return *global_pool;
+}
+
+void ThreadPool::set_num_threads(int num_threads) {
+    std::lock_guard<std::mutex> lock(global_mutex);
+    global_pool = std::make_unique<ThreadPool>(std::max(1, num_threads));
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Fixed-size pool of worker threads for data-parallel loops
+ *
+ * parallel_for() splits an index range into contiguous chunks, runs one chunk
+ * on the calling thread and the rest on the workers, and returns once every
+ * chunk is done. A parallel_for issued from inside a worker runs inline, so
+ * nested parallel code cannot deadlock the pool.
+ *
+ * Layers share one process-wide pool, sized with ThreadPool::set_num_threads().
+ * The default of 1 thread keeps everything on the calling thread.
+ *
+ * A call allocates nothing: the job lives on the caller's stack, the body is
+ * reached through a plain function pointer, and workers claim chunks from it
+ * under the pool mutex.
+ */
+class ThreadPool {
+public:
+    // num_threads counts the calling thread, so a pool of N starts N - 1 workers
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int num_threads() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Calls body(i) for every i in [begin, end)
+    template <class Body>
+    void parallel_for(int begin, int end, Body&& body) {
+        int count = end - begin;
+        if (count <= 0) {
+            return;
+        }
+        if (runs_inline(count)) {
+            for (int i = begin; i < end; ++i) {
+                body(i);
+            }
+            return;
+        }
+        using Callable = std::remove_reference_t<Body>;
+        Job job;
+        job.call = [](const void* callable, int i) { (*static_cast<Callable*>(const_cast<void*>(callable)))(i); };
+        job.body = std::addressof(body);
+        job.begin = begin;
+        job.count = count;
+        run(job);
+    }
+
+    // True on the worker threads of any pool, where parallel_for runs inline
+    static bool on_worker_thread();
+
+    // Shared pool used by the layers
+    static ThreadPool& global();
+    static void set_num_threads(int num_threads);
+
+private:
+    // One parallel_for in flight. Everything but the body is guarded by mutex
+    struct Job {
+        void (*call)(const void* body, int i);
+        const void* body;
+        int begin = 0, count = 0, num_chunks = 0;
+        int next_chunk = 0;
+        int remaining = 0;
+        std::exception_ptr error;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<Job*> jobs;  // Jobs that may still have unclaimed chunks
+    std::mutex mutex;
+    std::condition_variable task_available;
+    std::condition_variable chunk_done;
+    bool stopping = false;
+
+    bool runs_inline(int count) const;
+    void run(Job& job);
+    // Runs one chunk with the lock released, then reports it done
+    void run_chunk(Job& job, int chunk, std::unique_lock<std::mutex>& lock);
+    Job* claimable_job() const;
+    void worker_loop();
+};
+
+// Per-thread scratch of at least count elements that only ever grows, so hot loops get
+// working memory without allocating once warmed up. Each Tag gets its own buffer;
+// the contents are garbage on entry and only valid until the same Tag is used again
+template <class T, class Tag>
+T* thread_scratch(std::size_t count) {
+    thread_local std::vector<T> buffer;
+    if (buffer.size() < count) {
+        buffer.resize(count);
+    }
+    return buffer.data();
+}
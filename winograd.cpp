@@ -0,0 +1,173 @@
+#include "winograd.hpp"
+#include "thread_pool.hpp"
+#include <stdexcept>
+
+namespace {
+    // Transform matrices for F(M x M, 3 x 3) (Lavin & Gray), fixed-size so the
+    // per-tile products stay on the stack
+    template <int M>
+    struct Transform {
+        static constexpr int A = M + 2;
+        Eigen::Matrix<Scalar, A, A> BT;
+        Eigen::Matrix<Scalar, A, 3> G;
+        Eigen::Matrix<Scalar, M, A> AT;
+        Transform();
+    };
+
+    template <>
+    Transform<2>::Transform() {
+        BT << 1,  0, -1,  0,
+              0,  1,  1,  0,
+              0, -1,  1,  0,
+              0,  1,  0, -1;
+        G << 1,    0,    0,
+             0.5,  0.5,  0.5,
+             0.5, -0.5,  0.5,
+             0,    0,    1;
+        AT << 1, 1,  1,  0,
+              0, 1, -1, -1;
+    }
+
+    template <>
+    Transform<4>::Transform() {
+        BT << 4,  0, -5,  0, 1, 0,
+              0, -4, -4,  1, 1, 0,
+              0,  4, -4, -1, 1, 0,
+              0, -2, -1,  2, 1, 0,
+              0,  2, -1, -2, 1, 0,
+              0,  4,  0, -5, 0, 1;
+        G << 1.0 / 4,        0,        0,
+            -1.0 / 6, -1.0 / 6, -1.0 / 6,
+            -1.0 / 6,  1.0 / 6, -1.0 / 6,
+             1.0 / 24, 1.0 / 12, 1.0 / 6,
+             1.0 / 24, -1.0 / 12, 1.0 / 6,
+             0,        0,        1;
+        AT << 1, 1,  1, 1,  1, 0,
+              0, 1, -1, 2, -2, 0,
+              0, 1,  1, 4,  4, 0,
+              0, 1, -1, 8, -8, 1;
+    }
+
+    template <int M>
+    void transform_filters(const Tensor& kernels, bool flip, Tensor::Matrix& filters) {
+        constexpr int A = M + 2;
+        const Transform<M> t;
+        // flip swaps the roles of the filter and channel axes
+        int out_channels = flip ? kernels.channels() : kernels.batch();
+        int in_channels = flip ? kernels.batch() : kernels.channels();
+
+        filters.resize(A * A * out_channels, in_channels);
+        for (int o = 0; o < out_channels; ++o) {
+            for (int c = 0; c < in_channels; ++c) {
+                Eigen::Matrix<Scalar, 3, 3> g;
+                for (int y = 0; y < 3; ++y) {
+                    for (int x = 0; x < 3; ++x) {
+                        g(y, x) = flip ? kernels(c, o, 2 - y, 2 - x) : kernels(o, c, y, x);
+                    }
+                }
+                Eigen::Matrix<Scalar, A, A> u = t.G * g * t.G.transpose();
+                for (int xi = 0; xi < A * A; ++xi) {
+                    filters(xi * out_channels + o, c) = u(xi / A, xi % A);
+                }
+            }
+        }
+    }
+
+    template <int M>
+    void convolve(const Tensor::Matrix& filters, const Tensor& input, int padding, Tensor& output,
+                  Winograd::Workspace& workspace) {
+        constexpr int A = M + 2;
+        const Transform<M> t;
+        int batch = input.batch();
+        int in_channels = input.channels();
+        int out_channels = output.channels();
+        int in_h = input.height(), in_w = input.width();
+        int out_h = output.height(), out_w = output.width();
+        int tiles_h = (out_h + M - 1) / M;
+        int tiles_w = (out_w + M - 1) / M;
+        int tiles = tiles_h * tiles_w;
+        long positions = static_cast<long>(batch) * tiles;
+        ThreadPool& pool = ThreadPool::global();
+
+        // Input transform: block xi of transformed holds element xi of every
+        // channel's tiles, one column per (sample, tile)
+        Tensor::Matrix& transformed = workspace.transformed;
+        transformed.resize(A * A * in_channels, positions);
+        pool.parallel_for(0, batch * in_channels, [&](int task) {
+            int n = task / in_channels, c = task % in_channels;
+            Eigen::Matrix<Scalar, A, A> d;
+            for (int th = 0; th < tiles_h; ++th) {
+                for (int tw = 0; tw < tiles_w; ++tw) {
+                    int top = th * M - padding, left = tw * M - padding;
+                    for (int y = 0; y < A; ++y) {
+                        for (int x = 0; x < A; ++x) {
+                            int iy = top + y, ix = left + x;
+                            bool inside = iy >= 0 && iy < in_h && ix >= 0 && ix < in_w;
+                            d(y, x) = inside ? input(n, c, iy, ix) : Scalar(0);
+                        }
+                    }
+                    Eigen::Matrix<Scalar, A, A> v = t.BT * d * t.BT.transpose();
+                    long col = static_cast<long>(n) * tiles + th * tiles_w + tw;
+                    for (int xi = 0; xi < A * A; ++xi) {
+                        transformed(xi * in_channels + c, col) = v(xi / A, xi % A);
+                    }
+                }
+            }
+        });
+
+        // One GEMM per transform position does the channel reduction
+        Tensor::Matrix& products = workspace.products;
+        products.resize(A * A * out_channels, positions);
+        pool.parallel_for(0, A * A, [&](int xi) {
+            products.middleRows(xi * out_channels, out_channels).noalias() =
+                filters.middleRows(xi * out_channels, out_channels) *
+                transformed.middleRows(xi * in_channels, in_channels);
+        });
+
+        // Output transform, dropping the parts of edge tiles that fall outside the output
+        pool.parallel_for(0, batch * out_channels, [&](int task) {
+            int n = task / out_channels, o = task % out_channels;
+            Eigen::Matrix<Scalar, A, A> m;
+            for (int th = 0; th < tiles_h; ++th) {
+                for (int tw = 0; tw < tiles_w; ++tw) {
+                    long col = static_cast<long>(n) * tiles + th * tiles_w + tw;
+                    for (int xi = 0; xi < A * A; ++xi) {
+                        m(xi / A, xi % A) = products(xi * out_channels + o, col);
+                    }
+                    Eigen::Matrix<Scalar, M, M> y = t.AT * m * t.AT.transpose();
+                    for (int dy = 0; dy < M && th * M + dy < out_h; ++dy) {
+                        for (int dx = 0; dx < M && tw * M + dx < out_w; ++dx) {
+                            output(n, o, th * M + dy, tw * M + dx) = y(dy, dx);
+                        }
+                    }
+                }
+            }
+        });
+    }
+}
+
+namespace Winograd {
+    bool supported_tile(int m) {
+        return m == 2 || m == 4;
+    }
+
+    void transform_filters(int m, const Tensor& kernels, bool flip, Tensor::Matrix& filters) {
+        if (kernels.height() != 3 || kernels.width() != 3) {
+            throw std::invalid_argument("Winograd filters must be 3x3");
+        }
+        switch (m) {
+            case 2: return ::transform_filters<2>(kernels, flip, filters);
+            case 4: return ::transform_filters<4>(kernels, flip, filters);
+        }
+        throw std::invalid_argument("Unsupported Winograd tile size " + std::to_string(m));
+    }
+
+    void convolve(int m, const Tensor::Matrix& filters, const Tensor& input, int padding, Tensor& output,
+                  Workspace& workspace) {
+        switch (m) {
+            case 2: return ::convolve<2>(filters, input, padding, output, workspace);
+            case 4: return ::convolve<4>(filters, input, padding, output, workspace);
+        }
+        throw std::invalid_argument("Unsupported Winograd tile size " + std::to_string(m));
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "tensor.hpp"
+
+/**
+ * @brief Winograd minimal filtering F(m x m, 3 x 3) for stride-1 3x3 convolutions
+ *
+ * Each m x m output tile is computed from an (m + 2) x (m + 2) input tile with
+ * (m + 2)^2 multiplies per (filter, channel) pair instead of 9 m^2, i.e. 2.25x
+ * fewer for m = 2 and 4x fewer for m = 4. The channel sums become (m + 2)^2
+ * independent GEMMs.
+ *
+ * Tolerance against the direct path (max abs difference relative to max |output|), for
+ * forward and every gradient; conv_algorithms_test.cpp checks these bounds:
+ *   F(2x2, 3x3): below 1e-15 in double, 1e-6 in float
+ *   F(4x4, 3x3): below 1e-14 in double, 1e-5 in float (larger transform constants)
+ */
+namespace Winograd {
+    // Output tile sizes with transform matrices available
+    bool supported_tile(int m);
+
+    // Transforms a (out_channels, in_channels, 3, 3) filter bank into (m + 2)^2 stacked
+    // (out_channels x in_channels) blocks. With flip set, the bank is read as the transposed,
+    // 180-degree rotated version of kernels, which is what the input gradient is convolved with.
+    // filters is resized to fit and overwritten, so a matrix kept between calls keeps its storage.
+    void transform_filters(int m, const Tensor& kernels, bool flip, Tensor::Matrix& filters);
+
+    // Intermediate matrices of convolve, kept by the caller so repeated calls of one shape reuse them
+    struct Workspace {
+        Tensor::Matrix transformed;  // ((m + 2)^2 * in_channels) x (batch * tiles)
+        Tensor::Matrix products;     // ((m + 2)^2 * out_channels) x (batch * tiles)
+    };
+
+    // output(n, o) = sum over c of input(n, c) zero-padded by padding, cross-correlated with filter (o, c).
+    // output must already have its final shape and is overwritten.
+    void convolve(int m, const Tensor::Matrix& filters, const Tensor& input, int padding, Tensor& output,
+                  Workspace& workspace);
+}
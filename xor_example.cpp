@@ -8,21 +8,15 @@
 
 int main() {
     // Create training data for XOR
-    std::vector<Eigen::MatrixXd> x_train = {
-        Eigen::MatrixXd::Constant(2, 1, 0),  // [0, 0]
-        Eigen::MatrixXd::Constant(2, 1, 0),  // [0, 0]
-        Eigen::MatrixXd::Constant(2, 1, 1),  // [1, 1]
-        Eigen::MatrixXd::Constant(2, 1, 1)   // [1, 1]
-    };
-    x_train[1](1, 0) = 1;  // [0, 1]
-    x_train[2](1, 0) = 0;  // [1, 0]
+    // 4 samples of (1 channel, 2x1)
+    Tensor x_train(4, 1, 2, 1);
+    x_train.flat() << 0, 0,   // [0, 0]
+                      0, 1,   // [0, 1]
+                      1, 0,   // [1, 0]
+                      1, 1;   // [1, 1]
 
-    std::vector<Eigen::MatrixXd> y_train = {
-        Eigen::MatrixXd::Constant(1, 1, 0),  // 0
-        Eigen::MatrixXd::Constant(1, 1, 1),  // 1
-        Eigen::MatrixXd::Constant(1, 1, 1),  // 1
-        Eigen::MatrixXd::Constant(1, 1, 0)   // 0
-    };
+    Tensor y_train(4, 1, 1, 1);
+    y_train.flat() << 0, 1, 1, 0;
 
     // Create network layers
     std::vector<std::shared_ptr<Layer>> layers = {
@@ -38,10 +32,11 @@ int main() {
 
     // Test the network
     std::cout << "\nTesting the network:" << std::endl;
-    for (const auto& x : x_train) {
-        Eigen::MatrixXd prediction = network.predict(x);
-        std::cout << "Input: [" << x(0, 0) << ", " << x(1, 0) 
-                  << "], Output: " << prediction(0, 0) << std::endl;
+    for (int i = 0; i < x_train.batch(); ++i) {
+        Tensor x = x_train.sample(i);
+        Tensor prediction = network.predict(x);
+        std::cout << "Input: [" << x(0, 0, 0, 0) << ", " << x(0, 0, 1, 0) 
+                  << "], Output: " << prediction(0, 0, 0, 0) << std::endl;
     }
 
     return 0;